@@ -0,0 +1,186 @@
+#include "cppjson.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Heap allocations so far, counted by the replaced operator new.
+static size_t allocations = 0;
+
+void *operator new(size_t size) {
+  allocations++;
+  if (auto *p = std::malloc(size == 0 ? 1 : size))
+    return p;
+  throw std::bad_alloc();
+}
+// Out of line, so the compiler does not pair inlined free() calls with new.
+[[gnu::noinline]] void operator delete(void *p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void *p, size_t) noexcept {
+  std::free(p);
+}
+
+struct BenchResult {
+  std::string bench_name;
+  size_t bytes;
+  // Per-iteration latencies in microseconds, sorted.
+  std::vector<double> samples;
+  double allocs_per_iteration;
+  void print() const {
+    double total = 0;
+    for (auto us : samples)
+      total += us;
+    std::cout << "\n=========== BENCH " << bench_name << " ============\n";
+    std::cout << "iterations = " << samples.size() << std::endl;
+    std::cout << "bytes = " << bytes << std::endl;
+    std::cout << "avg = " << total / samples.size() << " us" << std::endl;
+    std::cout << "p50 = " << percentile(0.50) << " us" << std::endl;
+    std::cout << "p99 = " << percentile(0.99) << " us" << std::endl;
+    std::cout << "allocs = " << allocs_per_iteration << " per iteration"
+              << std::endl;
+  }
+  double percentile(double p) const {
+    return samples[static_cast<size_t>(p * (samples.size() - 1))];
+  }
+};
+
+BenchResult bench(std::string bench_name, int iterations,
+                  std::function<size_t()> body) {
+  size_t bytes = body();
+  std::vector<double> samples;
+  samples.reserve(iterations);
+  auto allocs_before = allocations;
+  for (int i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    bytes = body();
+    std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - start;
+    samples.push_back(elapsed.count());
+  }
+  double allocs = static_cast<double>(allocations - allocs_before) / iterations;
+  std::sort(samples.begin(), samples.end());
+  return {std::move(bench_name), bytes, std::move(samples), allocs};
+}
+
+// Runs the bodies in turns of `iterations / rounds`, so that warm-up and heap
+// state favour none of them, and merges each body's samples.
+std::vector<BenchResult>
+benchInterleaved(int iterations, int rounds,
+                 std::vector<std::pair<std::string, std::function<size_t()>>>
+                     bodies) {
+  std::vector<BenchResult> res;
+  for (auto &[name, body] : bodies)
+    res.push_back({name, 0, {}, 0});
+  for (int round = 0; round < rounds; round++) {
+    for (size_t i = 0; i < bodies.size(); i++) {
+      auto part = bench(bodies[i].first, iterations / rounds, bodies[i].second);
+      auto &r = res[i];
+      r.bytes = part.bytes;
+      r.samples.insert(r.samples.end(), part.samples.begin(),
+                       part.samples.end());
+      r.allocs_per_iteration += part.allocs_per_iteration / rounds;
+    }
+  }
+  for (auto &r : res)
+    std::sort(r.samples.begin(), r.samples.end());
+  return res;
+}
+
+std::string makeDocument(int records) {
+  std::string s = "[";
+  for (int i = 0; i < records; i++) {
+    auto n = std::to_string(i);
+    s += R"({"id":)" + n + R"(,"name":"user-)" + n + R"(","score":)" +
+         std::to_string(i % 100) + R"(.5,"active":)" +
+         (i % 2 ? "true" : "false") +
+         R"(,"tags":["a","bb","ccc"],"pos":{"x":)" +
+         std::to_string(i * 3) + R"(,"y":-)" + std::to_string(i * 7) +
+         R"(},"note":null},)";
+  }
+  s.pop_back();
+  s += "]";
+  return s;
+}
+
+int main() {
+  const int iterations = 50;
+  auto text = makeDocument(2000);
+  auto json = JSON::parse(text);
+  auto msgpack = JSON::to_msgpack(json);
+  auto cbor = JSON::to_cbor(json);
+
+  std::vector<BenchResult> result;
+
+  result.push_back(bench("text round trip", iterations, [&] {
+    return JSON::parse(text)->dump().size();
+  }));
+  result.push_back(bench("msgpack round trip", iterations, [&] {
+    return JSON::to_msgpack(JSON::from_msgpack(msgpack)).size();
+  }));
+  result.push_back(bench("cbor round trip", iterations, [&] {
+    return JSON::to_cbor(JSON::from_cbor(cbor)).size();
+  }));
+
+  // One field edited between dumps of a big document.
+  const int edit_iterations = 1000;
+  int64_t counter = 0;
+  auto &first = json->cast<JSON::Array>()[0]->cast<JSON::Object>();
+  result.push_back(bench("dump after edit, Node::dump", edit_iterations, [&] {
+    first["id"] = counter++;
+    return json->dump().size();
+  }));
+  JSON::DumpCache cache;
+  result.push_back(
+      bench("dump after edit, JSON::DumpCache", edit_iterations, [&] {
+        first["id"] = counter++;
+        return cache.dump(json).size();
+      }));
+
+  // Many small documents, as an RPC layer sees them. Each body walks the
+  // same documents in the same order.
+  std::vector<std::string> small;
+  for (int i = 0; i < 64; i++) {
+    small.push_back(makeDocument(8 + i % 8));
+  }
+  const int small_iterations = 100000;
+  const int small_rounds = 20;
+
+  // The same documents validated during the parse, tags and pos left
+  // unbuilt.
+  auto schema = JSON::Schema::compile(R"({
+    "type": "array",
+    "items": {
+      "type": "object",
+      "required": ["id", "name"],
+      "properties": {
+        "id": {"type": "integer", "minimum": 0},
+        "name": {"type": "string", "maxLength": 16},
+        "tags": {"x-skip": true},
+        "pos": {"x-skip": true}
+      }
+    }
+  })");
+  JSON::ParseOptions opts;
+  opts.schema = &schema;
+  size_t next_plain = 0, next_schema = 0;
+  for (auto &r : benchInterleaved(
+           small_iterations, small_rounds,
+           {{"small documents, JSON::parse",
+             [&] {
+               auto &s = small[next_plain++ % small.size()];
+               return JSON::parse(s)->cast<JSON::Array>().size();
+             }},
+            {"small documents, JSON::parse + schema", [&] {
+               auto &s = small[next_schema++ % small.size()];
+               return JSON::parse(s, opts)->cast<JSON::Array>().size();
+             }}}))
+    result.push_back(std::move(r));
+
+  for (const auto &r : result) {
+    r.print();
+  }
+}
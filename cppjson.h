@@ -1,7 +1,12 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cctype>
+#include <charconv>
+#include <cmath>
 #include <codecvt>
 #include <cstddef>
 #include <cstdint>
@@ -10,6 +15,7 @@
 #include <format>
 #include <initializer_list>
 #include <iostream>
+#include <iterator>
 #include <limits>
 #include <locale>
 #include <memory>
@@ -40,6 +46,34 @@ public:
   public:
     using JSONException::JSONException;
   };
+  class JSONSchemaException : public JSONParseException {
+    size_t offset_;
+
+  public:
+    JSONSchemaException(const std::string &what, size_t offset)
+        : JSONParseException(what), offset_(offset) {}
+    // Where the violating value starts in the parsed text.
+    size_t offset() const noexcept { return offset_; }
+  };
+
+  class Schema;
+
+  struct ParseOptions {
+    // Keep numbers as views of the source text and convert them on first
+    // access. The source text must outlive the parsed tree.
+    bool lazy_numbers = false;
+
+    // Limits for untrusted input. Parsing fails as soon as one is exceeded.
+    // `max_bytes` bounds the memoryUsage() of the resulting tree.
+    size_t max_bytes = std::numeric_limits<size_t>::max();
+    size_t max_nodes = std::numeric_limits<size_t>::max();
+    size_t max_string_length = std::numeric_limits<size_t>::max();
+    size_t max_object_members = std::numeric_limits<size_t>::max();
+
+    // Validate against a compiled schema while parsing. Must outlive the
+    // parse call.
+    const Schema *schema = nullptr;
+  };
 
   enum class NodeType {
     Null,
@@ -60,21 +94,50 @@ public:
 
 private:
   std::unique_ptr<Node> _uptr;
+  // The container whose slot this is. Assigning through the slot invalidates
+  // the container's cached dump.
+  Node *owner_ = nullptr;
+
+  inline void adopt_(Node *owner) noexcept {
+    owner_ = owner;
+    if (_uptr)
+      _uptr->reparent_(owner);
+  }
+
+  inline JSON &reset_(std::unique_ptr<Node> &&uptr) noexcept {
+    _uptr = std::move(uptr);
+    if (_uptr)
+      _uptr->reparent_(owner_);
+    if (owner_ != nullptr)
+      owner_->invalidate();
+    return *this;
+  }
 
 public:
   JSON() : _uptr(std::make_unique<Null>()) {};
-  JSON(JSON &&) = default;
+  JSON(JSON &&o) noexcept : _uptr(std::move(o._uptr)) {
+    if (o.owner_ != nullptr)
+      o.owner_->invalidate();
+    if (_uptr)
+      _uptr->reparent_(nullptr);
+  }
+  JSON(const JSON &) = delete;
 
   template <typename T>
     requires std::is_base_of_v<Node, T>
   explicit JSON(std::unique_ptr<T> &&uptr) : _uptr(std::move(uptr)) {}
 
-  JSON &operator=(JSON &&) = default;
+  inline JSON &operator=(JSON &&o) noexcept {
+    if (this == &o)
+      return *this;
+    if (o.owner_ != nullptr)
+      o.owner_->invalidate();
+    return reset_(std::move(o._uptr));
+  }
   JSON &operator=(const JSON &) = delete;
 
   inline JSON &operator=(std::unique_ptr<Node> &&uptr) {
-    _uptr = std::move(uptr);
-    return *this;
+    return reset_(std::move(uptr));
   }
 
   template <typename T>
@@ -84,20 +147,17 @@ public:
   template <typename T>
     requires std::is_base_of_v<Node, T>
   inline JSON &operator=(T &&node) {
-    _uptr = std::make_unique<T>(std::forward<T>(node));
-    return *this;
+    return reset_(std::make_unique<T>(std::forward<T>(node)));
   }
 
   explicit JSON(std::nullptr_t) : JSON() {}
   inline JSON &operator=(std::nullptr_t) {
-    _uptr = std::make_unique<Null>();
-    return *this;
+    return reset_(std::make_unique<Null>());
   }
 
   explicit JSON(bool boolean) : _uptr(std::make_unique<Boolean>(boolean)) {}
   inline JSON &operator=(bool boolean) {
-    _uptr = std::make_unique<Boolean>(boolean);
-    return *this;
+    return reset_(std::make_unique<Boolean>(boolean));
   }
 
   template <typename IntN>
@@ -107,28 +167,24 @@ public:
   template <typename IntN>
     requires std::numeric_limits<IntN>::is_integer
   inline JSON &operator=(IntN integer) {
-    _uptr = std::make_unique<Number>(static_cast<int64_t>(integer));
-    return *this;
+    return reset_(std::make_unique<Number>(static_cast<int64_t>(integer)));
   }
 
   explicit JSON(double float_number)
       : _uptr(std::make_unique<Number>(float_number)) {}
   inline JSON &operator=(double float_number) {
-    _uptr = std::make_unique<Number>(float_number);
-    return *this;
+    return reset_(std::make_unique<Number>(float_number));
   }
 
   explicit JSON(std::string str)
       : _uptr(std::make_unique<String>(std::move(str))) {}
   inline JSON &operator=(std::string str) {
-    _uptr = std::make_unique<String>(std::move(str));
-    return *this;
+    return reset_(std::make_unique<String>(std::move(str)));
   }
 
   explicit JSON(const char *c_str) : _uptr(std::make_unique<String>(c_str)) {}
   inline JSON &operator=(const char *c_str) {
-    _uptr = std::make_unique<String>(c_str);
-    return *this;
+    return reset_(std::make_unique<String>(c_str));
   }
 
   std::unique_ptr<Node> &operator->() { return _uptr; }
@@ -159,11 +215,212 @@ private:
     }
   }
 
+  // Buffers the recursive parsers share instead of growing their own. Open
+  // containers push their children here and move them into an exactly sized
+  // container once closed.
+  struct ParseScratch {
+    std::vector<JSON> values{};
+    std::vector<std::string> keys{};
+    std::string str{};
+  };
+
+  static constexpr size_t NO_SCHEMA_RULE = std::numeric_limits<size_t>::max();
+
+  struct SchemaProperty {
+    // Set for names listed in "properties"; names that are only required
+    // fall back to the additionalProperties rule.
+    bool declared = false;
+    size_t rule = NO_SCHEMA_RULE;
+    size_t required_bit = NO_SCHEMA_RULE;
+  };
+
+  // One compiled (sub)schema. Child schemas are indices into Schema::rules_,
+  // NO_SCHEMA_RULE accepts anything.
+  struct SchemaRule {
+    // Bitmask of schemaTypeBit() values.
+    unsigned types = ~0u;
+    bool skip = false;
+    std::unordered_map<std::string, SchemaProperty> properties{};
+    std::vector<std::string> required{};
+    bool additional_allowed = true;
+    size_t additional = NO_SCHEMA_RULE;
+    size_t items = NO_SCHEMA_RULE;
+    std::vector<JSON> enum_values{};
+    std::optional<double> minimum{};
+    std::optional<double> maximum{};
+    std::optional<size_t> max_length{};
+  };
+
+  // State of one JSON::parse call, threaded through the recursive parsers.
+  struct ParseContext {
+    const ParseOptions &opts;
+    ParseScratch &scratch;
+    size_t nodes = 0;
+    size_t bytes = 0;
+    // Schema rules and the rule of the value being parsed.
+    const SchemaRule *rules = nullptr;
+    size_t rule = NO_SCHEMA_RULE;
+    const char *begin = nullptr;
+  };
+
+  // Fails if `pending` more bytes would not fit into ParseOptions::max_bytes.
+  static void assert_bytes(std::string_view &sv, const ParseContext &ctx,
+                           size_t pending) {
+    if (pending > ctx.opts.max_bytes - ctx.bytes) {
+      throw getJSONParseError(sv, ".., max bytes exceeded");
+    }
+  }
+
+  static void charge_bytes(std::string_view &sv, ParseContext &ctx,
+                           size_t bytes) {
+    assert_bytes(sv, ctx, bytes);
+    ctx.bytes += bytes;
+  }
+
+  // Converting a double outside int64_t's range is undefined, so clamp.
+  inline static constexpr int64_t saturateInt64(double d) noexcept {
+    if (d != d)
+      return 0;
+    if (d >= 0x1p63)
+      return std::numeric_limits<int64_t>::max();
+    if (d < -0x1p63)
+      return std::numeric_limits<int64_t>::min();
+    return static_cast<int64_t>(d);
+  }
+
+  // Writes the shortest text that reads back as the same double, keeping a
+  // `.` or an exponent so it is parsed as a double again. JSON has no
+  // infinities or NaN, so those are written as null.
+  inline static void appendDouble(std::string &out, double d) {
+    if (!std::isfinite(d)) {
+      out += "null";
+      return;
+    }
+    char buf[32];
+    auto end = std::to_chars(buf, buf + sizeof(buf), d).ptr;
+    std::string_view text(buf, end - buf);
+    out += text;
+    if (text.find_first_of(".e") == std::string_view::npos)
+      out += ".0";
+  }
+
+  // Heap bytes behind a std::string; zero while it lives in the SSO buffer.
+  inline static size_t stringHeapBytes(const std::string &s) noexcept {
+    auto data = reinterpret_cast<const char *>(s.data());
+    auto self = reinterpret_cast<const char *>(&s);
+    return data >= self && data < self + sizeof(s) ? 0 : s.capacity() + 1;
+  }
+
+  static constexpr size_t NO_POSITION = std::numeric_limits<size_t>::max();
+
+  // Where the output of an array or object sits in the last DumpCache
+  // result. Offsets are relative to the parent's output, so a subtree copied
+  // as a whole keeps the ranges of everything below it valid.
+  struct DumpRange {
+    size_t off = 0;
+    size_t len = 0;
+    // DumpCache::dump() that last wrote this node as a document root.
+    uint64_t stamp = 0;
+    // Nothing below the node changed since its output was written.
+    bool valid = false;
+    // `off` and `len` describe the node at its current position.
+    bool placed = false;
+  };
+
 public:
   class Node {
+    friend class JSON;
+
+  protected:
+    // The container holding this node, so that mutating a value can
+    // invalidate the cached output of the containers above it.
+    Node *parent_ = nullptr;
+
+    // Cached dump bookkeeping. Only arrays and objects have any.
+    virtual inline DumpRange *dumpRange_() const noexcept { return nullptr; }
+
+    // Marks this node as mutated. Every cached ancestor is invalidated too,
+    // while untouched siblings keep their cached output.
+    inline void invalidate() noexcept {
+      if (auto range = dumpRange_())
+        range->valid = false;
+      for (Node *n = parent_; n != nullptr; n = n->parent_) {
+        auto range = n->dumpRange_();
+        if (!range->valid)
+          break;
+        range->valid = false;
+      }
+    }
+
+    // Moves the node to a new position; ranges recorded at the old one no
+    // longer apply.
+    inline void reparent_(Node *parent) noexcept {
+      if (parent_ != nullptr) {
+        if (auto range = dumpRange_()) {
+          range->placed = false;
+          range->stamp = 0;
+        }
+      }
+      parent_ = parent;
+    }
+
+    // Appends the output of a node that started at `prev_begin` in `prev`,
+    // copying the subtrees that did not change since. NO_POSITION writes
+    // everything anew.
+    virtual inline void dumpCachedTo(std::string &out, const std::string &,
+                                     size_t) const {
+      dumpTo(out);
+    }
+
+    // dumpCachedTo() for the child of a container whose output starts at
+    // `parent_begin` in `out` and started at `prev_parent` in `prev`.
+    inline void dumpChildCached_(std::string &out, const std::string &prev,
+                                 size_t prev_parent,
+                                 size_t parent_begin) const {
+      auto range = dumpRange_();
+      if (range == nullptr)
+        return dumpTo(out);
+      auto prev_begin = prev_parent == NO_POSITION || !range->placed
+                            ? NO_POSITION
+                            : prev_parent + range->off;
+      range->off = out.size() - parent_begin;
+      range->placed = true;
+      if (prev_begin != NO_POSITION && range->valid)
+        out.append(prev, prev_begin, range->len);
+      else
+        dumpCachedTo(out, prev, prev_begin);
+    }
+
   public:
-    inline static std::unique_ptr<Node> parse(std::string_view &sv, int dep) {
+    Node() = default;
+    // The parent link belongs to the position in a tree, not to the value.
+    Node(const Node &) noexcept {}
+    Node &operator=(const Node &) noexcept {
+      invalidate();
+      return *this;
+    }
+
+    inline static std::unique_ptr<Node> parse(std::string_view &sv, int dep,
+                                              ParseContext &ctx) {
       assert_depth(sv, dep);
+      if (++ctx.nodes > ctx.opts.max_nodes)
+        throw getJSONParseError(sv, ".., max node count exceeded");
+      removeWhiteSpaces(sv);
+      // Containers point ctx.rule at their children's rules.
+      auto rule = ctx.rule;
+      auto start = sv;
+      if (rule != NO_SCHEMA_RULE)
+        checkSchemaType(start, ctx, ctx.rules[rule]);
+      auto res = parseValue(sv, dep, ctx);
+      ctx.rule = rule;
+      if (rule != NO_SCHEMA_RULE)
+        checkSchemaValue(start, ctx, ctx.rules[rule], *res);
+      charge_bytes(sv, ctx, res->shallowMemoryUsage());
+      return res;
+    }
+
+    inline static std::unique_ptr<Node> parseValue(std::string_view &sv,
+                                                   int dep, ParseContext &ctx) {
       removeWhiteSpaces(sv);
       switch (sv[0]) {
       case 'n':
@@ -172,11 +429,11 @@ public:
       case 'f':
         return Boolean::parse(sv);
       case '{':
-        return Object::parse(sv, dep + 1);
+        return Object::parse(sv, dep + 1, ctx);
       case '[':
-        return Array::parse(sv, dep + 1);
+        return Array::parse(sv, dep + 1, ctx);
       case '"':
-        return String::parse(sv);
+        return String::parse(sv, ctx);
       case '-':
       case '0':
       case '1':
@@ -188,7 +445,7 @@ public:
       case '7':
       case '8':
       case '9':
-        return Number::parse(sv);
+        return Number::parse(sv, ctx);
       default:
         throw getJSONParseError(sv, "any JSON value");
       }
@@ -196,6 +453,14 @@ public:
 
     virtual inline NodeType getType() const noexcept = 0;
 
+    // Bytes owned by this node alone: the node and its buffers, without its
+    // children. Allocator bookkeeping is not included.
+    virtual inline size_t shallowMemoryUsage() const noexcept = 0;
+    // Bytes owned by this node and everything below it.
+    virtual inline size_t memoryUsage() const noexcept {
+      return shallowMemoryUsage();
+    }
+
     template <class T>
       requires std::is_base_of_v<Node, T>
     inline T &cast() noexcept {
@@ -224,6 +489,9 @@ public:
       throw JSONException("unreachable: a JSON::Node has no nodetype");
     };
 
+    // Appends the serialized node to `out`.
+    virtual inline void dumpTo(std::string &out) const { out += dump(); }
+
     virtual ~Node() {};
   };
 
@@ -238,6 +506,9 @@ public:
       throw getJSONParseError(sv, "`null`");
     }
     inline NodeType getType() const noexcept override { return NodeType::Null; }
+    inline size_t shallowMemoryUsage() const noexcept override {
+      return sizeof(Null);
+    }
     inline std::string dump() const noexcept override { return "null"; }
   };
 
@@ -271,6 +542,9 @@ public:
     inline NodeType getType() const noexcept override {
       return NodeType::Boolean;
     }
+    inline size_t shallowMemoryUsage() const noexcept override {
+      return sizeof(Boolean);
+    }
     bool value() const { return value_; }
     inline std::string dump() const noexcept override {
       return value_ ? "true" : "false";
@@ -278,51 +552,196 @@ public:
   };
 
   class Number : public Node {
-    int64_t value_int_{};
-    double value_double_{};
-    bool is_double_{};
-    std::string str_raw_{};
+    // Conversion results; filled on first access for lazy numbers.
+    mutable int64_t value_int_{};
+    mutable double value_double_{};
+    mutable bool is_double_{};
+    mutable bool materialized_ = true;
+    // Which member of the union below holds the literal.
+    bool is_view_ = false;
+    // The literal of a parsed number: a view of the source text for lazy
+    // numbers, an owned copy otherwise. Empty for numbers set from a value.
+    union {
+      std::string str_raw_{};
+      std::string_view str_view_;
+    };
+
+    std::string_view literal() const noexcept {
+      return is_view_ ? str_view_ : std::string_view(str_raw_);
+    }
+    void ownLiteral_(std::string text) noexcept {
+      if (is_view_) {
+        std::construct_at(&str_raw_, std::move(text));
+        is_view_ = false;
+      } else {
+        str_raw_ = std::move(text);
+      }
+    }
+    void viewLiteral_(std::string_view text) noexcept {
+      if (!is_view_) {
+        std::destroy_at(&str_raw_);
+        std::construct_at(&str_view_, text);
+        is_view_ = true;
+      } else {
+        str_view_ = text;
+      }
+    }
+    void clearLiteral_() noexcept {
+      if (is_view_)
+        str_view_ = {};
+      else
+        str_raw_.clear();
+    }
+
+    inline void materialize() const {
+      if (materialized_)
+        return;
+      materialized_ = true;
+      auto text = literal();
+      auto first = text.data(), last = first + text.size();
+      if (!is_double_) {
+        if (std::from_chars(first, last, value_int_).ec == std::errc()) {
+          value_double_ = value_int_;
+          return;
+        }
+        // Too big for int64_t: degrade to double like Number::parse does.
+        is_double_ = true;
+      }
+      if (std::from_chars(first, last, value_double_).ec != std::errc()) {
+        // Out of range. strtod picks the right infinity or zero for us.
+        value_double_ = std::strtod(std::string(text).c_str(), nullptr);
+      }
+      value_int_ = saturateInt64(value_double_);
+    }
+
+    // Whether a literal may lie outside double's range, judged by its length
+    // and exponent alone. Doubles span about 1e-324 to 1e308.
+    inline static bool mayBeOutOfRange(std::string_view literal) noexcept {
+      auto e = literal.find_first_of("eE");
+      size_t exp = 0;
+      if (e != std::string_view::npos) {
+        for (auto c : literal.substr(e + 1)) {
+          if (c >= '0' && c <= '9' && exp < 1000)
+            exp = exp * 10 + (c - '0');
+        }
+      }
+      return literal.size() + exp > 290;
+    }
 
   public:
+    struct LazyT {
+      explicit LazyT() = default;
+    };
+
     explicit Number(std::string str_raw, bool is_double)
         : is_double_(is_double), str_raw_(std::move(str_raw)) {
       if (is_double) {
         value_double_ = std::stod(str_raw_);
-        value_int_ = value_double_;
+        value_int_ = saturateInt64(value_double_);
       } else {
         value_int_ = std::stoll(str_raw_);
         value_double_ = value_int_;
       }
     }
+    explicit Number(LazyT, std::string_view str_view, bool is_double)
+        : is_double_(is_double), materialized_(false), is_view_(true),
+          str_view_(str_view) {}
     explicit Number(int64_t integer)
         : value_int_(integer), value_double_(integer), is_double_(false) {};
     explicit Number(double float_num)
-        : value_int_(float_num), value_double_(float_num), is_double_(true) {};
-    Number(Number &&) = default;
-    Number(const Number &) = default;
-    Number &operator=(Number &&) = default;
-    Number &operator=(const Number &) = default;
+        : value_int_(saturateInt64(float_num)), value_double_(float_num),
+          is_double_(true) {};
+    // Moving changes what the source dumps, so its containers are
+    // invalidated like those of the destination.
+    Number(Number &&o) noexcept
+        : Node(o), value_int_(o.value_int_), value_double_(o.value_double_),
+          is_double_(o.is_double_), materialized_(o.materialized_) {
+      if (o.is_view_)
+        viewLiteral_(o.str_view_);
+      else
+        ownLiteral_(std::move(o.str_raw_));
+      o.invalidate();
+    }
+    Number(const Number &o)
+        : Node(o), value_int_(o.value_int_), value_double_(o.value_double_),
+          is_double_(o.is_double_), materialized_(o.materialized_) {
+      if (o.is_view_)
+        viewLiteral_(o.str_view_);
+      else
+        ownLiteral_(o.str_raw_);
+    }
+    Number &operator=(Number &&o) noexcept {
+      Node::operator=(o);
+      value_int_ = o.value_int_;
+      value_double_ = o.value_double_;
+      is_double_ = o.is_double_;
+      materialized_ = o.materialized_;
+      if (o.is_view_)
+        viewLiteral_(o.str_view_);
+      else
+        ownLiteral_(std::move(o.str_raw_));
+      o.invalidate();
+      return *this;
+    }
+    Number &operator=(const Number &o) {
+      Node::operator=(o);
+      value_int_ = o.value_int_;
+      value_double_ = o.value_double_;
+      is_double_ = o.is_double_;
+      materialized_ = o.materialized_;
+      if (o.is_view_)
+        viewLiteral_(o.str_view_);
+      else
+        ownLiteral_(o.str_raw_);
+      return *this;
+    }
+    ~Number() override {
+      if (!is_view_)
+        std::destroy_at(&str_raw_);
+    }
 
-    inline static std::unique_ptr<Number> parse(std::string_view &sv) {
+    inline static std::unique_ptr<Number> parse(std::string_view &sv,
+                                                ParseContext &ctx) {
       removeWhiteSpaces(sv);
       bool is_double = false;
       auto ptr = std::ranges::find_if_not(sv, [&is_double](char c) {
-        if (c == '.') [[unlikely]] {
+        if (c == '.' || c == 'e' || c == 'E') [[unlikely]] {
           return is_double = true;
         }
-        return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == 'e' ||
-               c == 'E';
+        return (c >= '0' && c <= '9') || c == '-' || c == '+';
       });
       auto n = static_cast<size_t>(ptr - sv.begin());
-      std::string numsv(sv.substr(0, n));
-      sv.remove_prefix(std::min(n, sv.size()));
+      auto numsv = sv.substr(0, n);
+
+      if (ctx.opts.lazy_numbers) {
+        // std::stoll needs a digit after the sign; std::stod also takes a
+        // `.` followed by a digit, as in -.5.
+        auto digits = numsv.substr(numsv.starts_with('-') ? 1 : 0);
+        auto isDigit = [&digits](size_t i) {
+          return i < digits.size() && digits[i] >= '0' && digits[i] <= '9';
+        };
+        if (!isDigit(0) &&
+            !(is_double && digits.starts_with('.') && isDigit(1)))
+          throw getJSONParseError(sv.substr(n - digits.size()), "digit");
+        sv.remove_prefix(n);
+        // Reject what the eager path rejects. Only rare literals pay for it.
+        if (mayBeOutOfRange(numsv)) {
+          try {
+            std::stod(std::string(numsv));
+          } catch (const std::exception &) {
+            throw getJSONParseError(sv, "but got out of range");
+          }
+        }
+        return std::make_unique<Number>(LazyT{}, numsv, is_double);
+      }
 
+      sv.remove_prefix(std::min(n, sv.size()));
       try {
-        return std::make_unique<Number>(std::move(numsv), is_double);
+        return std::make_unique<Number>(std::string(numsv), is_double);
       } catch (const std::exception &e) {
         if (!is_double) {
           try {
-            return std::make_unique<Number>(std::string(sv.substr(0, n)), true);
+            return std::make_unique<Number>(std::string(numsv), true);
           } catch (const std::exception &e) {
             throw getJSONParseError(sv, "but got out of range");
           }
@@ -331,28 +750,69 @@ public:
       }
     }
 
-    int64_t value_int() const { return value_int_; }
-    double value_double() const { return value_double_; }
-    bool is_double() const { return is_double_; }
+    // Doubles are truncated and clamped to the int64_t range.
+    //
+    // The first access to a lazy number stores the converted value, so an
+    // unconverted lazy tree must not be read from several threads at once.
+    int64_t value_int() const {
+      materialize();
+      return value_int_;
+    }
+    double value_double() const {
+      materialize();
+      return value_double_;
+    }
+    bool is_double() const {
+      materialize();
+      return is_double_;
+    }
+    // Whether the value is an integer that int64_t holds exactly.
+    bool fits_int64() const {
+      materialize();
+      if (!is_double_)
+        return true;
+      return value_double_ >= -0x1p63 && value_double_ < 0x1p63 &&
+             std::trunc(value_double_) == value_double_;
+    }
+    // Whether the literal has not been converted yet.
+    bool is_lazy() const noexcept { return !materialized_; }
 
     inline void set(int64_t x) {
+      invalidate();
       is_double_ = false;
-      str_raw_.clear();
+      materialized_ = true;
+      clearLiteral_();
       value_int_ = x;
+      value_double_ = x;
     }
     inline void set(double d) {
+      invalidate();
       is_double_ = true;
-      str_raw_.clear();
+      materialized_ = true;
+      clearLiteral_();
       value_double_ = d;
+      value_int_ = saturateInt64(d);
     }
 
     inline NodeType getType() const noexcept override {
       return NodeType::Number;
     }
+    inline size_t shallowMemoryUsage() const noexcept override {
+      return sizeof(Number) + (is_view_ ? 0 : stringHeapBytes(str_raw_));
+    }
     inline std::string dump() const noexcept override {
-      return str_raw_.empty() ? is_double_ ? std::to_string(value_double_)
-                                           : std::to_string(value_int_)
-                              : str_raw_;
+      std::string s;
+      dumpTo(s);
+      return s;
+    }
+    // Echoes the source literal of a parsed number without converting it.
+    inline void dumpTo(std::string &out) const override {
+      if (auto text = literal(); !text.empty())
+        out += text;
+      else if (is_double_)
+        appendDouble(out, value_double_);
+      else
+        out += std::to_string(value_int_);
     }
   };
 
@@ -383,17 +843,33 @@ public:
 
   public:
     explicit String(std::string str) : value_(std::move(str)) {};
-    String(String &&) = default;
+    String(String &&o) noexcept : Node(o), value_(std::move(o.value_)) {
+      o.invalidate();
+    }
     String(const String &) = default;
-    String &operator=(String &&) = default;
+    String &operator=(String &&o) noexcept {
+      Node::operator=(o);
+      value_ = std::move(o.value_);
+      o.invalidate();
+      return *this;
+    }
     String &operator=(const String &) = default;
 
-    inline static std::unique_ptr<String> parse(std::string_view &sv) {
+    inline static std::unique_ptr<String> parse(std::string_view &sv,
+                                                ParseContext &ctx) {
+      return std::make_unique<String>(parseString(sv, ctx));
+    }
+
+    // Unescapes into the scratch buffer, so the result is allocated once at
+    // its final size.
+    inline static std::string parseString(std::string_view &sv,
+                                          ParseContext &ctx) {
       removeWhiteSpaces(sv);
       if (sv[0] != '"')
         throw getJSONParseError(sv, "string start `\"`");
       sv.remove_prefix(1);
-      std::string res;
+      auto &res = ctx.scratch.str;
+      res.clear();
       size_t n = 1;
       while (true) {
         auto ptr = std::ranges::find_if(
@@ -412,12 +888,15 @@ public:
 
         res += sv.substr(0, n);
         sv.remove_prefix(n);
+        if (res.size() > ctx.opts.max_string_length)
+          throw getJSONParseError(sv, ".., max string length exceeded");
+        assert_bytes(sv, ctx, res.size() + 1);
 
         if (sv.empty()) {
           throw getJSONParseError(sv, "string end `\"`");
         } else if (sv[0] == '"') {
           sv.remove_prefix(1);
-          return std::make_unique<String>(std::move(res));
+          return std::string(res);
         } else {
           sv.remove_prefix(1);
           switch (sv[0]) {
@@ -474,7 +953,7 @@ public:
       }
     }
 
-    static std::string toJSONString(const std::string &s) {
+    static std::string toJSONString(std::string_view s) {
       std::string res = "\"";
       for (const auto c : s) {
         switch (c) {
@@ -509,19 +988,32 @@ public:
     }
 
     const std::string &value() const { return value_; }
-    std::string take() { return std::move(value_); }
+    std::string take() {
+      invalidate();
+      return std::move(value_);
+    }
 
-    template <typename T> void set(T &&v) { value_ = std::forward<T>(v); }
+    template <typename T> void set(T &&v) {
+      invalidate();
+      value_ = std::forward<T>(v);
+    }
 
     inline NodeType getType() const noexcept override {
       return NodeType::String;
     }
+    inline size_t shallowMemoryUsage() const noexcept override {
+      return sizeof(String) + stringHeapBytes(value_);
+    }
     inline std::string dump() const override { return toJSONString(value_); }
   };
 
   class Array : public Node {
+  public:
     using ArrayVT = std::vector<JSON>;
+
+  private:
     ArrayVT value_{};
+    mutable DumpRange range_{};
 
     static void pushArray_(Array &) {}
     template <typename T> static void pushArray_(Array &arr, T &&t) {
@@ -533,21 +1025,39 @@ public:
       pushArray_(arr, std::forward<Args>(args)...);
     }
 
+    void adoptChildren_() noexcept {
+      for (auto &v : value_)
+        v.adopt_(this);
+    }
+
   public:
     Array() {};
-    explicit Array(ArrayVT &&val) : value_(std::move(val)) {};
-    Array(Array &&) = default;
+    explicit Array(ArrayVT &&val) : value_(std::move(val)) {
+      adoptChildren_();
+    };
+    Array(Array &&o) noexcept : Node(o), value_(std::move(o.value_)) {
+      adoptChildren_();
+      o.invalidate();
+    }
     Array(const Array &) = delete;
-    Array &operator=(Array &&) = default;
+    Array &operator=(Array &&o) noexcept {
+      Node::operator=(o);
+      value_ = std::move(o.value_);
+      adoptChildren_();
+      o.invalidate();
+      return *this;
+    }
     Array &operator=(const Array &) = delete;
 
     template <typename... Args> static Array makeArray(Args &&...args) {
       Array res;
       pushArray_(res, std::forward<Args>(args)...);
+      res.adoptChildren_();
       return res;
     }
 
-    inline static std::unique_ptr<Array> parse(std::string_view &sv, int dep) {
+    inline static std::unique_ptr<Array> parse(std::string_view &sv, int dep,
+                                               ParseContext &ctx) {
       assert_depth(sv, dep);
       removeWhiteSpaces(sv);
       if (sv[0] != '[')
@@ -555,16 +1065,27 @@ public:
       sv.remove_prefix(1);
       removeWhiteSpaces(sv);
 
-      ArrayVT val;
+      auto &stack = ctx.scratch.values;
+      auto mark = stack.size();
       bool isTComma = false;
+      auto item_rule = ctx.rule == NO_SCHEMA_RULE ? NO_SCHEMA_RULE
+                                                  : ctx.rules[ctx.rule].items;
+      bool skip_items =
+          item_rule != NO_SCHEMA_RULE && ctx.rules[item_rule].skip;
 
       while (sv[0] != ']') {
-        val.emplace_back(Node::parse(sv, dep + 1));
+        if (skip_items) {
+          skipValue(sv, dep + 1);
+        } else {
+          assert_bytes(sv, ctx, (stack.size() - mark + 1) * sizeof(JSON));
+          ctx.rule = item_rule;
+          stack.emplace_back(Node::parse(sv, dep + 1, ctx));
+        }
         removeWhiteSpaces(sv);
         switch (sv[0]) {
         case ']':
           sv.remove_prefix(1);
-          return std::make_unique<Array>(std::move(val));
+          return fromScratch(ctx.scratch, mark);
         case ',':
           isTComma = true;
           sv.remove_prefix(1);
@@ -578,65 +1099,157 @@ public:
         throw getJSONParseError(sv, "next json value");
 
       sv.remove_prefix(1);
+      return fromScratch(ctx.scratch, mark);
+    }
+
+    // Moves the children pushed since `mark` into a new Array.
+    inline static std::unique_ptr<Array> fromScratch(ParseScratch &scratch,
+                                                     size_t mark) {
+      auto &stack = scratch.values;
+      ArrayVT val;
+      val.reserve(stack.size() - mark);
+      std::move(stack.begin() + mark, stack.end(), std::back_inserter(val));
+      stack.erase(stack.begin() + mark, stack.end());
       return std::make_unique<Array>(std::move(val));
     }
 
     inline NodeType getType() const noexcept override {
       return NodeType::Array;
     }
-    inline std::string dump() const override {
-      std::string s = "[";
+    inline size_t shallowMemoryUsage() const noexcept override {
+      return sizeof(Array) + value_.capacity() * sizeof(JSON);
+    }
+    inline size_t memoryUsage() const noexcept override {
+      auto res = shallowMemoryUsage();
+      for (const auto &v : value_)
+        res += v->memoryUsage();
+      return res;
+    }
+    inline void dumpTo(std::string &out) const override {
+      out += '[';
       for (const auto &v : value_) {
-        s += v->dump();
-        s += ",";
+        v->dumpTo(out);
+        out += ',';
       }
       if (!value_.empty())
-        s.pop_back();
-      s += ']';
+        out.pop_back();
+      out += ']';
+    }
+    inline std::string dump() const override {
+      std::string s;
+      dumpTo(s);
       return s;
     }
 
     JSON &operator[](size_t idx) { return value_.at(idx); }
+    const ArrayVT &value() const { return value_; }
+    size_t size() const noexcept { return value_.size(); }
+
+  protected:
+    inline DumpRange *dumpRange_() const noexcept override { return &range_; }
+    inline void dumpCachedTo(std::string &out, const std::string &prev,
+                             size_t prev_begin) const override {
+      auto begin = out.size();
+      out += '[';
+      for (const auto &v : value_) {
+        v->dumpChildCached_(out, prev, prev_begin, begin);
+        out += ',';
+      }
+      if (!value_.empty())
+        out.pop_back();
+      out += ']';
+      range_.len = out.size() - begin;
+      range_.valid = true;
+    }
   };
 
   class Object : public Node {
+  public:
     using ObjectVT = std::unordered_map<std::string, JSON>;
+
+  private:
     ObjectVT value_{};
+    mutable DumpRange range_{};
+
+    void adoptChildren_() noexcept {
+      for (auto &[key, val] : value_)
+        val.adopt_(this);
+    }
 
   public:
     Object() {};
-    explicit Object(ObjectVT &&val) : value_(std::move(val)) {};
-    Object(Object &&) = default;
+    explicit Object(ObjectVT &&val) : value_(std::move(val)) {
+      adoptChildren_();
+    };
+    Object(Object &&o) noexcept : Node(o), value_(std::move(o.value_)) {
+      adoptChildren_();
+      o.invalidate();
+    }
     Object(const Object &) = delete;
-    Object &operator=(Object &&) = default;
+    Object &operator=(Object &&o) noexcept {
+      Node::operator=(o);
+      value_ = std::move(o.value_);
+      adoptChildren_();
+      o.invalidate();
+      return *this;
+    }
     Object &operator=(const Object &) = delete;
 
-    inline static std::unique_ptr<Object> parse(std::string_view &sv, int dep) {
+    inline static std::unique_ptr<Object> parse(std::string_view &sv, int dep,
+                                                ParseContext &ctx) {
       assert_depth(sv, dep);
       removeWhiteSpaces(sv);
       if (sv[0] != '{')
         throw getJSONParseError(sv, "object start `{`");
       sv.remove_prefix(1);
       removeWhiteSpaces(sv);
-      ObjectVT val;
+      auto &keys = ctx.scratch.keys;
+      auto &values = ctx.scratch.values;
+      auto mark = keys.size();
+      auto vmark = values.size();
       bool isTComma = false;
+      auto rule = ctx.rule;
+      uint64_t seen_required = 0;
+      // Bytes charged for the staged keys and their hash nodes.
+      size_t charged = 0;
       while (sv[0] != '}') {
-        auto key = String::parse(sv);
-        if (ENABLE_DUMPLICATED_KEY_DETECT && val.contains(key->value())) {
+        if (keys.size() - mark >= ctx.opts.max_object_members)
+          throw getJSONParseError(sv, ".., max object members exceeded");
+        removeWhiteSpaces(sv);
+        auto key_start = sv;
+        auto key = String::parseString(sv, ctx);
+        auto member_rule = NO_SCHEMA_RULE;
+        if (rule != NO_SCHEMA_RULE)
+          member_rule = schemaMemberRule(key_start, ctx, ctx.rules[rule], key,
+                                         seen_required);
+        if (ENABLE_DUMPLICATED_KEY_DETECT &&
+            std::find(keys.begin() + mark, keys.end(), key) != keys.end()) {
           throw getJSONParseError(
-              sv, ("unique key, but got dumplicated key `" + key->value() + "`")
-                      .c_str());
+              sv,
+              ("unique key, but got dumplicated key `" + key + "`").c_str());
         } else {
           removeWhiteSpaces(sv);
           if (sv[0] != ':')
             throw getJSONParseError(sv, "object spliter `:`");
           sv.remove_prefix(1);
-          val.insert({key->take(), JSON(Node::parse(sv, dep + 1))});
+          if (member_rule != NO_SCHEMA_RULE && ctx.rules[member_rule].skip) {
+            skipValue(sv, dep + 1);
+          } else {
+            auto key_bytes = stringHeapBytes(key) + hashNodeSize();
+            charge_bytes(sv, ctx, key_bytes);
+            charged += key_bytes;
+            assert_bytes(sv, ctx, (values.size() - vmark + 1) * sizeof(JSON));
+            keys.push_back(std::move(key));
+            ctx.rule = member_rule;
+            values.emplace_back(Node::parse(sv, dep + 1, ctx));
+          }
           removeWhiteSpaces(sv);
           switch (sv[0]) {
           case '}':
+            if (rule != NO_SCHEMA_RULE)
+              checkSchemaRequired(sv, ctx, ctx.rules[rule], seen_required);
             sv.remove_prefix(1);
-            return std::make_unique<Object>(std::move(val));
+            return fromScratch(ctx, mark, vmark, charged);
           case ',':
             sv.remove_prefix(1);
             isTComma = true;
@@ -648,37 +1261,1899 @@ public:
       }
       if (isTComma && !ENABLE_TRAILING_COMMA)
         throw getJSONParseError(sv, "next json value");
+      if (rule != NO_SCHEMA_RULE)
+        checkSchemaRequired(sv, ctx, ctx.rules[rule], seen_required);
       sv.remove_prefix(1);
+      return fromScratch(ctx, mark, vmark, charged);
+    }
+
+    // Moves the members pushed since `mark`/`vmark` into a new Object. The
+    // first of duplicated keys wins. The `charged` key bytes and the values
+    // that lost are given back; Node::parse charges the finished Object, so
+    // the charged total stays equal to memoryUsage().
+    inline static std::unique_ptr<Object>
+    fromScratch(ParseContext &ctx, size_t mark, size_t vmark, size_t charged) {
+      auto &keys = ctx.scratch.keys;
+      auto &values = ctx.scratch.values;
+      ObjectVT val;
+      val.reserve(keys.size() - mark);
+      for (size_t i = 0; i < keys.size() - mark; i++) {
+        // try_emplace leaves the value alone when the key is taken.
+        if (!val.try_emplace(std::move(keys[mark + i]),
+                             std::move(values[vmark + i]))
+                 .second)
+          ctx.bytes -= values[vmark + i]->memoryUsage();
+      }
+      ctx.bytes -= charged;
+      keys.erase(keys.begin() + mark, keys.end());
+      values.erase(values.begin() + vmark, values.end());
       return std::make_unique<Object>(std::move(val));
     }
 
     inline NodeType getType() const noexcept override {
       return NodeType::Object;
     }
-    inline std::string dump() const override {
-      std::string s = "{";
+    // A hash node holds the next link, the key/value pair and the cached
+    // hash of the key.
+    inline static constexpr size_t hashNodeSize() noexcept {
+      return sizeof(void *) + sizeof(ObjectVT::value_type) + sizeof(size_t);
+    }
+    inline size_t shallowMemoryUsage() const noexcept override {
+      auto res = sizeof(Object) + value_.size() * hashNodeSize();
+      if (value_.bucket_count() > 1)
+        res += value_.bucket_count() * sizeof(void *);
+      for (const auto &[key, val] : value_)
+        res += stringHeapBytes(key);
+      return res;
+    }
+    inline size_t memoryUsage() const noexcept override {
+      auto res = shallowMemoryUsage();
+      for (const auto &[key, val] : value_)
+        res += val->memoryUsage();
+      return res;
+    }
+    inline void dumpTo(std::string &out) const override {
+      out += '{';
       for (const auto &[key, val] : value_) {
-        s += String::toJSONString(key);
-        s += ":";
-        s += val->dump();
-        s += ",";
+        out += String::toJSONString(key);
+        out += ':';
+        val->dumpTo(out);
+        out += ',';
       }
       if (!value_.empty())
-        s.pop_back();
-      s += '}';
+        out.pop_back();
+      out += '}';
+    }
+    inline std::string dump() const override {
+      std::string s;
+      dumpTo(s);
       return s;
     }
 
-    JSON &operator[](const std::string &s) { return value_[s]; }
+    JSON &operator[](const std::string &s) {
+      auto [it, inserted] = value_.try_emplace(s);
+      if (inserted) {
+        it->second.adopt_(this);
+        invalidate();
+      }
+      return it->second;
+    }
+    const ObjectVT &value() const { return value_; }
+    size_t size() const noexcept { return value_.size(); }
+
+  protected:
+    inline DumpRange *dumpRange_() const noexcept override { return &range_; }
+    inline void dumpCachedTo(std::string &out, const std::string &prev,
+                             size_t prev_begin) const override {
+      auto begin = out.size();
+      out += '{';
+      for (const auto &[key, val] : value_) {
+        out += String::toJSONString(key);
+        out += ':';
+        val->dumpChildCached_(out, prev, prev_begin, begin);
+        out += ',';
+      }
+      if (!value_.empty())
+        out.pop_back();
+      out += '}';
+      range_.len = out.size() - begin;
+      range_.valid = true;
+    }
   };
 
-public:
-  static JSON parse(std::string_view sv) {
-    auto res = Node::parse(sv, 0);
+  // Re-serializes one document incrementally. Every array and object
+  // remembers where its output sits in the previous result and whether
+  // anything below it changed since, so unchanged subtrees are copied from
+  // there and only the mutated paths are serialized again. The cache holds
+  // the previous and the current output; the tree only holds the ranges.
+  //
+  // dump() writes that bookkeeping into the tree, so it must not run
+  // concurrently with another dump() or a mutation of the same tree. Plain
+  // Node::dump() does not touch it and stays safe to call concurrently.
+  class DumpCache {
+    inline static std::atomic<uint64_t> next_stamp_{0};
+
+    std::string out_{};
+    std::string prev_{};
+    uint64_t stamp_ = 0;
+
+  public:
+    const std::string &dump(const JSON &json) {
+      const Node &root = *json._uptr;
+      auto range = root.dumpRange_();
+      if (range == nullptr || root.parent_ != nullptr) {
+        // Scalars have nothing to reuse, and ranges inside a document are
+        // only kept up to date by dumping the whole document.
+        stamp_ = 0;
+        out_.clear();
+        root.dumpTo(out_);
+        return out_;
+      }
+      bool reuse = stamp_ != 0 && range->stamp == stamp_;
+      if (reuse && range->valid)
+        return out_;
+      std::swap(out_, prev_);
+      out_.clear();
+      root.dumpCachedTo(out_, prev_, reuse ? 0 : NO_POSITION);
+      stamp_ = range->stamp = ++next_stamp_;
+      return out_;
+    }
+
+    // The result of the last dump().
+    const std::string &str() const noexcept { return out_; }
+
+    size_t memoryUsage() const noexcept {
+      return sizeof(DumpCache) + stringHeapBytes(out_) +
+             stringHeapBytes(prev_);
+    }
+  };
+
+private:
+  inline static auto getBinaryParseError(std::string_view sv,
+                                         const char *excepted) {
+    auto unexpected_token =
+        sv.empty() ? std::string("EOF")
+                   : std::format("byte {:#04x}", static_cast<uint8_t>(sv[0]));
+    return JSONParseException(
+        std::format("Unexpected {} (excepted {})", unexpected_token, excepted));
+  }
+
+  static void assert_binary_depth(std::string_view sv, int current_depth) {
+    if (current_depth > MAX_RECURSE_DEPTH) {
+      throw getBinaryParseError(sv, ".., max rescurse depth exceeded");
+    }
+  }
+
+  // Writes the low `bytes` bytes of `v` in network (big-endian) order, which
+  // both MessagePack and CBOR use.
+  inline static void putBigEndian(std::string &out, uint64_t v, int bytes) {
+    for (int i = bytes - 1; i >= 0; i--)
+      out += static_cast<char>((v >> (i * 8)) & 0xFF);
+  }
+
+  inline static uint64_t takeBigEndian(std::string_view &sv, int bytes) {
+    if (sv.size() < static_cast<size_t>(bytes))
+      throw getBinaryParseError(sv.substr(sv.size()), "more bytes");
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++)
+      v = (v << 8) | static_cast<uint8_t>(sv[i]);
+    sv.remove_prefix(bytes);
+    return v;
+  }
+
+  inline static std::string_view takeBytes(std::string_view &sv, uint64_t n) {
+    if (sv.size() < n)
+      throw getBinaryParseError(sv.substr(sv.size()), "more bytes");
+    auto res = sv.substr(0, n);
+    sv.remove_prefix(n);
+    return res;
+  }
+
+  // Caps a container length read from the input by the bytes left, so a
+  // forged header can not make us reserve gigabytes up front.
+  inline static size_t reserveHint(std::string_view sv, uint64_t n) {
+    return static_cast<size_t>(std::min<uint64_t>(n, sv.size()));
+  }
+
+  // Unsigned integers that do not fit into int64_t degrade to double, like
+  // oversized integer literals do in Number::parse.
+  inline static std::unique_ptr<Number> makeUnsigned(uint64_t v) {
+    if (v > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+      return std::make_unique<Number>(static_cast<double>(v));
+    return std::make_unique<Number>(static_cast<int64_t>(v));
+  }
+
+  static void msgpackEncode(const Node &node, std::string &out) {
+    switch (node.getType()) {
+    case NodeType::Null:
+      out += '\xc0';
+      return;
+    case NodeType::Boolean:
+      out += node.cast<Boolean>().value() ? '\xc3' : '\xc2';
+      return;
+    case NodeType::Number: {
+      const auto &num = node.cast<Number>();
+      if (num.is_double()) {
+        out += '\xcb';
+        putBigEndian(out, std::bit_cast<uint64_t>(num.value_double()), 8);
+        return;
+      }
+      auto v = num.value_int();
+      if (v >= 0) {
+        if (v <= 0x7F) {
+          out += static_cast<char>(v);
+        } else if (v <= 0xFF) {
+          out += '\xcc';
+          putBigEndian(out, v, 1);
+        } else if (v <= 0xFFFF) {
+          out += '\xcd';
+          putBigEndian(out, v, 2);
+        } else if (v <= 0xFFFFFFFF) {
+          out += '\xce';
+          putBigEndian(out, v, 4);
+        } else {
+          out += '\xcf';
+          putBigEndian(out, v, 8);
+        }
+      } else {
+        auto u = static_cast<uint64_t>(v);
+        if (v >= -32) {
+          out += static_cast<char>(v);
+        } else if (v >= std::numeric_limits<int8_t>::min()) {
+          out += '\xd0';
+          putBigEndian(out, u, 1);
+        } else if (v >= std::numeric_limits<int16_t>::min()) {
+          out += '\xd1';
+          putBigEndian(out, u, 2);
+        } else if (v >= std::numeric_limits<int32_t>::min()) {
+          out += '\xd2';
+          putBigEndian(out, u, 4);
+        } else {
+          out += '\xd3';
+          putBigEndian(out, u, 8);
+        }
+      }
+      return;
+    }
+    case NodeType::String:
+      msgpackEncodeString(node.cast<String>().value(), out);
+      return;
+    case NodeType::Array: {
+      const auto &arr = node.cast<Array>().value();
+      if (arr.size() < 16) {
+        out += static_cast<char>(0x90 | arr.size());
+      } else if (arr.size() <= 0xFFFF) {
+        out += '\xdc';
+        putBigEndian(out, arr.size(), 2);
+      } else {
+        out += '\xdd';
+        putBigEndian(out, arr.size(), 4);
+      }
+      for (const auto &v : arr)
+        msgpackEncode(*v._uptr, out);
+      return;
+    }
+    case NodeType::Object: {
+      const auto &obj = node.cast<Object>().value();
+      if (obj.size() < 16) {
+        out += static_cast<char>(0x80 | obj.size());
+      } else if (obj.size() <= 0xFFFF) {
+        out += '\xde';
+        putBigEndian(out, obj.size(), 2);
+      } else {
+        out += '\xdf';
+        putBigEndian(out, obj.size(), 4);
+      }
+      for (const auto &[key, val] : obj) {
+        msgpackEncodeString(key, out);
+        msgpackEncode(*val._uptr, out);
+      }
+      return;
+    }
+    }
+    throw JSONException("unreachable: a JSON::Node has no nodetype");
+  }
+
+  inline static void msgpackEncodeString(const std::string &str,
+                                         std::string &out) {
+    if (str.size() < 32) {
+      out += static_cast<char>(0xA0 | str.size());
+    } else if (str.size() <= 0xFF) {
+      out += '\xd9';
+      putBigEndian(out, str.size(), 1);
+    } else if (str.size() <= 0xFFFF) {
+      out += '\xda';
+      putBigEndian(out, str.size(), 2);
+    } else {
+      out += '\xdb';
+      putBigEndian(out, str.size(), 4);
+    }
+    out += str;
+  }
+
+  inline static bool msgpackIsString(uint8_t head) noexcept {
+    return (head & 0xE0) == 0xA0 || (head >= 0xD9 && head <= 0xDB);
+  }
+
+  // Reads a fixstr or str8/16/32 whose header byte is `head`.
+  static std::string msgpackTakeString(std::string_view &sv, uint8_t head) {
+    uint64_t n = (head & 0xE0) == 0xA0 ? head & 0x1F
+                                        : takeBigEndian(sv, 1 << (head - 0xD9));
+    return std::string(takeBytes(sv, n));
+  }
+
+  static std::unique_ptr<Node> msgpackDecode(std::string_view &sv, int dep) {
+    assert_binary_depth(sv, dep);
+    if (sv.empty())
+      throw getBinaryParseError(sv, "any MessagePack value");
+    auto head = static_cast<uint8_t>(sv[0]);
+    auto rest = sv.substr(1);
+    uint64_t n = 0;
+    std::unique_ptr<Node> res;
+
+    if (head <= 0x7F) {
+      res = std::make_unique<Number>(static_cast<int64_t>(head));
+    } else if (head >= 0xE0) {
+      res = std::make_unique<Number>(static_cast<int64_t>(
+          static_cast<int8_t>(head)));
+    } else if (msgpackIsString(head)) {
+      res = std::make_unique<String>(msgpackTakeString(rest, head));
+    } else if ((head & 0xF0) == 0x90) {
+      sv = rest;
+      return msgpackDecodeArray(sv, head & 0x0F, dep + 1);
+    } else if ((head & 0xF0) == 0x80) {
+      sv = rest;
+      return msgpackDecodeObject(sv, head & 0x0F, dep + 1);
+    } else {
+      switch (head) {
+      case 0xC0:
+        res = std::make_unique<Null>();
+        break;
+      case 0xC2:
+      case 0xC3:
+        res = std::make_unique<Boolean>(head == 0xC3);
+        break;
+      case 0xCA:
+        res = std::make_unique<Number>(static_cast<double>(std::bit_cast<float>(
+            static_cast<uint32_t>(takeBigEndian(rest, 4)))));
+        break;
+      case 0xCB:
+        res = std::make_unique<Number>(
+            std::bit_cast<double>(takeBigEndian(rest, 8)));
+        break;
+      case 0xCC:
+      case 0xCD:
+      case 0xCE:
+      case 0xCF:
+        res = makeUnsigned(takeBigEndian(rest, 1 << (head - 0xCC)));
+        break;
+      case 0xD0:
+        res = std::make_unique<Number>(static_cast<int64_t>(
+            static_cast<int8_t>(takeBigEndian(rest, 1))));
+        break;
+      case 0xD1:
+        res = std::make_unique<Number>(static_cast<int64_t>(
+            static_cast<int16_t>(takeBigEndian(rest, 2))));
+        break;
+      case 0xD2:
+        res = std::make_unique<Number>(static_cast<int64_t>(
+            static_cast<int32_t>(takeBigEndian(rest, 4))));
+        break;
+      case 0xD3:
+        res = std::make_unique<Number>(
+            static_cast<int64_t>(takeBigEndian(rest, 8)));
+        break;
+      case 0xDC:
+      case 0xDD:
+        n = takeBigEndian(rest, head == 0xDC ? 2 : 4);
+        sv = rest;
+        return msgpackDecodeArray(sv, n, dep + 1);
+      case 0xDE:
+      case 0xDF:
+        n = takeBigEndian(rest, head == 0xDE ? 2 : 4);
+        sv = rest;
+        return msgpackDecodeObject(sv, n, dep + 1);
+      default:
+        throw getBinaryParseError(sv, "a MessagePack type JSON can represent");
+      }
+    }
+    sv = rest;
+    return res;
+  }
+
+  static std::unique_ptr<Array> msgpackDecodeArray(std::string_view &sv,
+                                                   uint64_t n, int dep) {
+    Array::ArrayVT val;
+    val.reserve(reserveHint(sv, n));
+    for (uint64_t i = 0; i < n; i++)
+      val.emplace_back(msgpackDecode(sv, dep));
+    return std::make_unique<Array>(std::move(val));
+  }
+
+  static std::unique_ptr<Object> msgpackDecodeObject(std::string_view &sv,
+                                                     uint64_t n, int dep) {
+    Object::ObjectVT val;
+    val.reserve(reserveHint(sv, n));
+    for (uint64_t i = 0; i < n; i++) {
+      if (sv.empty() || !msgpackIsString(static_cast<uint8_t>(sv[0])))
+        throw getBinaryParseError(sv, "string as object key");
+      auto key_head = static_cast<uint8_t>(sv[0]);
+      sv.remove_prefix(1);
+      auto key = msgpackTakeString(sv, key_head);
+      val.insert({std::move(key), JSON(msgpackDecode(sv, dep))});
+    }
+    return std::make_unique<Object>(std::move(val));
+  }
+
+  inline static void cborEncodeHead(std::string &out, uint8_t major,
+                                    uint64_t v) {
+    major <<= 5;
+    if (v < 24) {
+      out += static_cast<char>(major | v);
+    } else if (v <= 0xFF) {
+      out += static_cast<char>(major | 24);
+      putBigEndian(out, v, 1);
+    } else if (v <= 0xFFFF) {
+      out += static_cast<char>(major | 25);
+      putBigEndian(out, v, 2);
+    } else if (v <= 0xFFFFFFFF) {
+      out += static_cast<char>(major | 26);
+      putBigEndian(out, v, 4);
+    } else {
+      out += static_cast<char>(major | 27);
+      putBigEndian(out, v, 8);
+    }
+  }
+
+  static void cborEncode(const Node &node, std::string &out) {
+    switch (node.getType()) {
+    case NodeType::Null:
+      out += '\xf6';
+      return;
+    case NodeType::Boolean:
+      out += node.cast<Boolean>().value() ? '\xf5' : '\xf4';
+      return;
+    case NodeType::Number: {
+      const auto &num = node.cast<Number>();
+      if (num.is_double()) {
+        out += '\xfb';
+        putBigEndian(out, std::bit_cast<uint64_t>(num.value_double()), 8);
+      } else if (num.value_int() >= 0) {
+        cborEncodeHead(out, 0, num.value_int());
+      } else {
+        // Major type 1 stores -1 - n, which is the bitwise complement.
+        cborEncodeHead(out, 1, ~static_cast<uint64_t>(num.value_int()));
+      }
+      return;
+    }
+    case NodeType::String: {
+      const auto &str = node.cast<String>().value();
+      cborEncodeHead(out, 3, str.size());
+      out += str;
+      return;
+    }
+    case NodeType::Array: {
+      const auto &arr = node.cast<Array>().value();
+      cborEncodeHead(out, 4, arr.size());
+      for (const auto &v : arr)
+        cborEncode(*v._uptr, out);
+      return;
+    }
+    case NodeType::Object: {
+      const auto &obj = node.cast<Object>().value();
+      cborEncodeHead(out, 5, obj.size());
+      for (const auto &[key, val] : obj) {
+        cborEncodeHead(out, 3, key.size());
+        out += key;
+        cborEncode(*val._uptr, out);
+      }
+      return;
+    }
+    }
+    throw JSONException("unreachable: a JSON::Node has no nodetype");
+  }
+
+  // Reads the argument of an initial byte. Returns std::nullopt for the
+  // indefinite-length marker.
+  inline static std::optional<uint64_t> cborTakeArgument(std::string_view &sv,
+                                                         uint8_t head) {
+    auto info = head & 0x1F;
+    if (info < 24)
+      return info;
+    if (info < 28)
+      return takeBigEndian(sv, 1 << (info - 24));
+    if (info == 31)
+      return std::nullopt;
+    throw getBinaryParseError(sv, "a valid CBOR additional information");
+  }
+
+  inline static double cborHalfToDouble(uint16_t half) {
+    int exp = (half >> 10) & 0x1F;
+    int mant = half & 0x3FF;
+    double val;
+    if (exp == 0)
+      val = std::ldexp(mant, -24);
+    else if (exp != 31)
+      val = std::ldexp(mant + 1024, exp - 25);
+    else
+      val = mant == 0 ? std::numeric_limits<double>::infinity()
+                      : std::numeric_limits<double>::quiet_NaN();
+    return half & 0x8000 ? -val : val;
+  }
+
+  inline static bool cborTakeBreak(std::string_view &sv) {
+    if (sv.empty())
+      throw getBinaryParseError(sv, "CBOR break `0xff`");
+    if (static_cast<uint8_t>(sv[0]) != 0xFF)
+      return false;
+    sv.remove_prefix(1);
+    return true;
+  }
+
+  static std::string cborTakeText(std::string_view &sv, uint8_t head) {
+    auto n = cborTakeArgument(sv, head);
+    if (n)
+      return std::string(takeBytes(sv, *n));
+    // Indefinite-length text is a sequence of definite-length chunks.
+    std::string res;
+    while (!cborTakeBreak(sv)) {
+      auto chunk = static_cast<uint8_t>(sv[0]);
+      if ((chunk >> 5) != 3 || (chunk & 0x1F) == 31)
+        throw getBinaryParseError(sv, "definite-length text chunk");
+      sv.remove_prefix(1);
+      res += takeBytes(sv, *cborTakeArgument(sv, chunk));
+    }
+    return res;
+  }
+
+  static std::unique_ptr<Node> cborDecode(std::string_view &sv, int dep) {
+    assert_binary_depth(sv, dep);
+    if (sv.empty())
+      throw getBinaryParseError(sv, "any CBOR value");
+    auto head = static_cast<uint8_t>(sv[0]);
+    auto rest = sv.substr(1);
+
+    switch (head >> 5) {
+    case 0: {
+      auto v = cborTakeArgument(rest, head);
+      if (!v)
+        throw getBinaryParseError(sv, "a definite integer");
+      sv = rest;
+      return makeUnsigned(*v);
+    }
+    case 1: {
+      auto v = cborTakeArgument(rest, head);
+      if (!v)
+        throw getBinaryParseError(sv, "a definite integer");
+      sv = rest;
+      if (*v > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+        return std::make_unique<Number>(-1.0 - static_cast<double>(*v));
+      return std::make_unique<Number>(~static_cast<int64_t>(*v));
+    }
+    case 3: {
+      auto str = cborTakeText(rest, head);
+      sv = rest;
+      return std::make_unique<String>(std::move(str));
+    }
+    case 4: {
+      auto n = cborTakeArgument(rest, head);
+      sv = rest;
+      Array::ArrayVT val;
+      if (n) {
+        val.reserve(reserveHint(sv, *n));
+        for (uint64_t i = 0; i < *n; i++)
+          val.emplace_back(cborDecode(sv, dep + 1));
+      } else {
+        while (!cborTakeBreak(sv))
+          val.emplace_back(cborDecode(sv, dep + 1));
+      }
+      return std::make_unique<Array>(std::move(val));
+    }
+    case 5: {
+      auto n = cborTakeArgument(rest, head);
+      sv = rest;
+      Object::ObjectVT val;
+      if (n)
+        val.reserve(reserveHint(sv, *n));
+      for (uint64_t i = 0; n ? i < *n : !cborTakeBreak(sv); i++) {
+        if (sv.empty() || (static_cast<uint8_t>(sv[0]) >> 5) != 3)
+          throw getBinaryParseError(sv, "text string as object key");
+        auto key_head = static_cast<uint8_t>(sv[0]);
+        sv.remove_prefix(1);
+        auto key = cborTakeText(sv, key_head);
+        val.insert({std::move(key), JSON(cborDecode(sv, dep + 1))});
+      }
+      return std::make_unique<Object>(std::move(val));
+    }
+    case 6:
+      // Tags only annotate the following item; JSON has nowhere to keep them.
+      if (!cborTakeArgument(rest, head))
+        throw getBinaryParseError(sv, "a definite tag");
+      sv = rest;
+      return cborDecode(sv, dep + 1);
+    case 7: {
+      std::unique_ptr<Node> res;
+      switch (head & 0x1F) {
+      case 20:
+      case 21:
+        res = std::make_unique<Boolean>(head == 0xF5);
+        break;
+      case 22:
+      case 23:
+        res = std::make_unique<Null>();
+        break;
+      case 25:
+        res = std::make_unique<Number>(
+            cborHalfToDouble(static_cast<uint16_t>(takeBigEndian(rest, 2))));
+        break;
+      case 26:
+        res = std::make_unique<Number>(static_cast<double>(std::bit_cast<float>(
+            static_cast<uint32_t>(takeBigEndian(rest, 4)))));
+        break;
+      case 27:
+        res = std::make_unique<Number>(
+            std::bit_cast<double>(takeBigEndian(rest, 8)));
+        break;
+      default:
+        throw getBinaryParseError(sv, "a CBOR simple value JSON can represent");
+      }
+      sv = rest;
+      return res;
+    }
+    default:
+      throw getBinaryParseError(sv, "a CBOR type JSON can represent");
+    }
+  }
+
+public:
+  // Binary encodings of the same tree `JSON::parse` builds. Integers keep
+  // their smallest encoding and doubles are always written as float64, so a
+  // round trip preserves `Number::is_double()` and the exact value. Decoded
+  // doubles dump as their shortest round-trip text.
+  static std::string to_msgpack(const JSON &json) {
+    std::string out;
+    msgpackEncode(*json._uptr, out);
+    return out;
+  }
+
+  static JSON from_msgpack(std::string_view sv) {
+    auto res = msgpackDecode(sv, 0);
+    if (!sv.empty())
+      throw getBinaryParseError(sv, "EOF");
+    return JSON(std::move(res));
+  }
+
+  static std::string to_cbor(const JSON &json) {
+    std::string out;
+    cborEncode(*json._uptr, out);
+    return out;
+  }
+
+  static JSON from_cbor(std::string_view sv) {
+    auto res = cborDecode(sv, 0);
+    if (!sv.empty())
+      throw getBinaryParseError(sv, "EOF");
+    return JSON(std::move(res));
+  }
+
+private:
+  // Snapshot layout, all integers little-endian and every offset relative to
+  // the start of the buffer:
+  //   header: "CJSNAP01", u64 offset of the root record
+  //   record: u8 SnapshotTag, then
+  //     Int/Double: 8 bytes of value
+  //     NumberText: u64 length, literal of a number int64_t can not hold
+  //     String:     u64 length, bytes
+  //     Array:      u64 count, count x u64 child offset
+  //     Object:     u64 count, count x (u64 key offset, u64 value offset),
+  //                 sorted by key bytes so lookups can bisect
+  // Children are written before their parent, so the root record comes last.
+  static constexpr std::string_view SNAPSHOT_MAGIC = "CJSNAP01";
+  static constexpr size_t SNAPSHOT_HEADER_SIZE = 16;
+
+  enum class SnapshotTag : uint8_t {
+    Null,
+    False,
+    True,
+    Int,
+    Double,
+    String,
+    Array,
+    Object,
+    NumberText,
+  };
+
+  inline static constexpr void putLittleEndian(std::string &out, uint64_t v,
+                                               int bytes) {
+    for (int i = 0; i < bytes; i++)
+      out += static_cast<char>((v >> (i * 8)) & 0xFF);
+  }
+
+  inline static constexpr void patchLittleEndian(std::string &out, size_t off,
+                                                 uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++)
+      out[off + i] = static_cast<char>((v >> (i * 8)) & 0xFF);
+  }
+
+  inline static constexpr uint64_t snapshotPutString(std::string &out,
+                                                     std::string_view str) {
+    uint64_t off = out.size();
+    out += static_cast<char>(SnapshotTag::String);
+    putLittleEndian(out, str.size(), 8);
+    out += str;
+    return off;
+  }
+
+  // Writes the Object table for already written (key offset, value offset)
+  // entries, whose keys are read back from `out` to sort them.
+  inline static constexpr uint64_t
+  snapshotPutObject(std::string &out,
+                    std::vector<std::pair<uint64_t, uint64_t>> &entries) {
+    auto keyOf = [&out](uint64_t key_off) {
+      std::string_view sv(out);
+      uint64_t len = 0;
+      for (int i = 7; i >= 0; i--)
+        len = (len << 8) | static_cast<uint8_t>(sv[key_off + 1 + i]);
+      return sv.substr(key_off + 9, len);
+    };
+    // Keys are written in document order, so among duplicated keys the
+    // lowest offset is the first one, which is the one JSON::parse keeps.
+    std::sort(entries.begin(), entries.end(),
+              [&keyOf](const auto &a, const auto &b) {
+                auto ka = keyOf(a.first), kb = keyOf(b.first);
+                return ka != kb ? ka < kb : a.first < b.first;
+              });
+    auto dup = std::unique(entries.begin(), entries.end(),
+                           [&keyOf](const auto &a, const auto &b) {
+                             return keyOf(a.first) == keyOf(b.first);
+                           });
+    entries.erase(dup, entries.end());
+    uint64_t off = out.size();
+    out += static_cast<char>(SnapshotTag::Object);
+    putLittleEndian(out, entries.size(), 8);
+    for (const auto &[key_off, val_off] : entries) {
+      putLittleEndian(out, key_off, 8);
+      putLittleEndian(out, val_off, 8);
+    }
+    return off;
+  }
+
+  static uint64_t snapshotEncode(const Node &node, std::string &out) {
+    uint64_t off = out.size();
+    switch (node.getType()) {
+    case NodeType::Null:
+      out += static_cast<char>(SnapshotTag::Null);
+      return off;
+    case NodeType::Boolean:
+      out += static_cast<char>(node.cast<Boolean>().value()
+                                   ? SnapshotTag::True
+                                   : SnapshotTag::False);
+      return off;
+    case NodeType::Number: {
+      const auto &num = node.cast<Number>();
+      if (num.is_double()) {
+        out += static_cast<char>(SnapshotTag::Double);
+        putLittleEndian(out, std::bit_cast<uint64_t>(num.value_double()), 8);
+      } else {
+        out += static_cast<char>(SnapshotTag::Int);
+        putLittleEndian(out, num.value_int(), 8);
+      }
+      return off;
+    }
+    case NodeType::String:
+      return snapshotPutString(out, node.cast<String>().value());
+    case NodeType::Array: {
+      const auto &arr = node.cast<Array>().value();
+      std::vector<uint64_t> children;
+      children.reserve(arr.size());
+      for (const auto &v : arr)
+        children.push_back(snapshotEncode(*v._uptr, out));
+      off = out.size();
+      out += static_cast<char>(SnapshotTag::Array);
+      putLittleEndian(out, children.size(), 8);
+      for (auto child : children)
+        putLittleEndian(out, child, 8);
+      return off;
+    }
+    case NodeType::Object: {
+      const auto &obj = node.cast<Object>().value();
+      std::vector<std::pair<uint64_t, uint64_t>> entries;
+      entries.reserve(obj.size());
+      for (const auto &[key, val] : obj) {
+        auto key_off = snapshotPutString(out, key);
+        entries.emplace_back(key_off, snapshotEncode(*val._uptr, out));
+      }
+      return snapshotPutObject(out, entries);
+    }
+    }
+    throw JSONException("unreachable: a JSON::Node has no nodetype");
+  }
+
+public:
+  // Serializes `json` into a relocatable snapshot that SnapshotView can
+  // navigate in place, e.g. straight out of an mmapped file.
+  static std::string to_snapshot(const JSON &json) {
+    std::string out(SNAPSHOT_MAGIC);
+    putLittleEndian(out, 0, 8);
+    auto root = snapshotEncode(*json._uptr, out);
+    patchLittleEndian(out, SNAPSHOT_MAGIC.size(), root, 8);
+    return out;
+  }
+
+  // A read-only value inside a snapshot. It is two words wide, does not own
+  // the bytes, and decodes nothing until an accessor asks for it. Offsets are
+  // bounds checked and must point before their parent, so a corrupted
+  // snapshot throws instead of reading out of the buffer or looping.
+  class SnapshotView {
+    std::string_view data_;
+    uint64_t off_;
+
+    constexpr SnapshotView(std::string_view data, uint64_t off)
+        : data_(data), off_(off) {
+      need(off, 1);
+    }
+
+    constexpr void need(uint64_t off, uint64_t n) const {
+      if (off > data_.size() || n > data_.size() - off)
+        throw JSONException("corrupted snapshot: offset out of range");
+    }
+
+    constexpr uint64_t u64(uint64_t off) const {
+      need(off, 8);
+      uint64_t v = 0;
+      for (int i = 7; i >= 0; i--)
+        v = (v << 8) | static_cast<uint8_t>(data_[off + i]);
+      return v;
+    }
+
+    constexpr SnapshotTag tag() const {
+      return static_cast<SnapshotTag>(data_[off_]);
+    }
+
+    constexpr void expect(NodeType type) const {
+      if (getType() != type)
+        throw JSONException("snapshot value has a different type");
+    }
+
+    // Children are written before their parent. An offset at or after the
+    // parent's is corruption, e.g. a cycle.
+    constexpr SnapshotView child(uint64_t off) const {
+      if (off >= off_)
+        throw JSONException("corrupted snapshot: child after its parent");
+      return SnapshotView(data_, off);
+    }
+
+    constexpr SnapshotView entryKey(uint64_t idx) const {
+      return child(u64(off_ + 9 + idx * 16));
+    }
+
+    // The text is echoed by dump(), so it must be a number literal the
+    // compile-time parser could have written.
+    constexpr std::string_view numberText() const {
+      auto len = u64(off_ + 1);
+      need(off_ + 9, len);
+      auto text = data_.substr(off_ + 9, len);
+      if (!isNumberLiteral(text) || !staticInDoubleRange(text))
+        throw JSONException("corrupted snapshot: bad number literal");
+      return text;
+    }
+
+  public:
+    static constexpr SnapshotView open(std::string_view data) {
+      if (data.size() < SNAPSHOT_HEADER_SIZE ||
+          data.substr(0, SNAPSHOT_MAGIC.size()) != SNAPSHOT_MAGIC)
+        throw JSONException("not a snapshot: bad magic");
+      SnapshotView header(data, 0);
+      auto root = header.u64(SNAPSHOT_MAGIC.size());
+      if (root < SNAPSHOT_HEADER_SIZE)
+        throw JSONException("corrupted snapshot: root inside the header");
+      return SnapshotView(data, root);
+    }
+
+    constexpr NodeType getType() const {
+      switch (tag()) {
+      case SnapshotTag::Null:
+        return NodeType::Null;
+      case SnapshotTag::False:
+      case SnapshotTag::True:
+        return NodeType::Boolean;
+      case SnapshotTag::Int:
+      case SnapshotTag::Double:
+      case SnapshotTag::NumberText:
+        return NodeType::Number;
+      case SnapshotTag::String:
+        return NodeType::String;
+      case SnapshotTag::Array:
+        return NodeType::Array;
+      case SnapshotTag::Object:
+        return NodeType::Object;
+      }
+      throw JSONException("corrupted snapshot: unknown tag");
+    }
+
+    // Boolean
+    constexpr bool value_bool() const {
+      expect(NodeType::Boolean);
+      return tag() == SnapshotTag::True;
+    }
+
+    // Number
+    constexpr bool is_double() const {
+      expect(NodeType::Number);
+      // -0 is kept as text for its sign but is an integer, as in JSON::parse.
+      return tag() != SnapshotTag::Int &&
+             !(tag() == SnapshotTag::NumberText && numberText() == "-0");
+    }
+    constexpr int64_t value_int() const {
+      expect(NodeType::Number);
+      if (tag() == SnapshotTag::Int)
+        return static_cast<int64_t>(u64(off_ + 1));
+      if (!is_double())
+        return 0;
+      return saturateInt64(value_double());
+    }
+    // Number literals from the _cjson literal are converted here, at run
+    // time, since from_chars can not run in constant evaluation.
+    constexpr double value_double() const {
+      expect(NodeType::Number);
+      switch (tag()) {
+      case SnapshotTag::Int:
+        return static_cast<double>(static_cast<int64_t>(u64(off_ + 1)));
+      case SnapshotTag::Double:
+        return std::bit_cast<double>(u64(off_ + 1));
+      default: {
+        auto text = numberText();
+        double res = 0;
+        if (std::from_chars(text.data(), text.data() + text.size(), res).ec !=
+            std::errc())
+          res = std::strtod(std::string(text).c_str(), nullptr);
+        return res;
+      }
+      }
+    }
+
+    // String
+    constexpr std::string_view value_string() const {
+      expect(NodeType::String);
+      auto len = u64(off_ + 1);
+      need(off_ + 9, len);
+      return data_.substr(off_ + 9, len);
+    }
+
+    // Array and Object
+    constexpr size_t size() const {
+      uint64_t entry_size = getType() == NodeType::Array ? 8 : 16;
+      if (entry_size == 16)
+        expect(NodeType::Object);
+      auto n = u64(off_ + 1);
+      if (n > data_.size() / entry_size)
+        throw JSONException("corrupted snapshot: offset out of range");
+      need(off_ + 9, n * entry_size);
+      return n;
+    }
+
+    constexpr SnapshotView operator[](size_t idx) const {
+      expect(NodeType::Array);
+      if (idx >= size())
+        throw std::out_of_range("snapshot array index out of range");
+      return child(u64(off_ + 9 + idx * 8));
+    }
+
+    // Object members in key order.
+    constexpr std::string_view keyAt(size_t idx) const {
+      expect(NodeType::Object);
+      if (idx >= size())
+        throw std::out_of_range("snapshot object index out of range");
+      return entryKey(idx).value_string();
+    }
+    constexpr SnapshotView valueAt(size_t idx) const {
+      expect(NodeType::Object);
+      if (idx >= size())
+        throw std::out_of_range("snapshot object index out of range");
+      return child(u64(off_ + 17 + idx * 16));
+    }
+
+    constexpr std::optional<SnapshotView> find(std::string_view key) const {
+      expect(NodeType::Object);
+      size_t lo = 0, hi = size();
+      while (lo < hi) {
+        auto mid = lo + (hi - lo) / 2;
+        auto k = entryKey(mid).value_string();
+        if (k == key)
+          return valueAt(mid);
+        if (k < key)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      return std::nullopt;
+    }
+
+    constexpr SnapshotView operator[](std::string_view key) const {
+      auto res = find(key);
+      if (!res)
+        throw std::out_of_range("snapshot object has no such key");
+      return *res;
+    }
+
+    inline void dumpTo(std::string &out) const { dumpTo(out, 0); }
+    inline std::string dump() const {
+      std::string s;
+      dumpTo(s);
+      return s;
+    }
+
+    // Copies the value out of the snapshot into an ordinary mutable tree.
+    JSON toJSON() const { return toJSON(0); }
+
+  private:
+    // Deeply nested, even valid, snapshots are refused like deep JSON text.
+    static void assertDepth(int dep) {
+      if (dep > MAX_RECURSE_DEPTH)
+        throw JSONException("snapshot nested too deeply");
+    }
+
+    void dumpTo(std::string &out, int dep) const {
+      assertDepth(dep);
+      switch (getType()) {
+      case NodeType::Null:
+        out += "null";
+        return;
+      case NodeType::Boolean:
+        out += value_bool() ? "true" : "false";
+        return;
+      case NodeType::Number:
+        if (tag() == SnapshotTag::NumberText)
+          out += numberText();
+        else if (is_double())
+          appendDouble(out, value_double());
+        else
+          out += std::to_string(value_int());
+        return;
+      case NodeType::String:
+        out += String::toJSONString(value_string());
+        return;
+      case NodeType::Array:
+        out += '[';
+        for (size_t i = 0; i < size(); i++) {
+          if (i != 0)
+            out += ',';
+          (*this)[i].dumpTo(out, dep + 1);
+        }
+        out += ']';
+        return;
+      case NodeType::Object:
+        out += '{';
+        for (size_t i = 0; i < size(); i++) {
+          if (i != 0)
+            out += ',';
+          out += String::toJSONString(keyAt(i));
+          out += ':';
+          valueAt(i).dumpTo(out, dep + 1);
+        }
+        out += '}';
+        return;
+      }
+    }
+
+    JSON toJSON(int dep) const {
+      assertDepth(dep);
+      switch (getType()) {
+      case NodeType::Null:
+        return JSON();
+      case NodeType::Boolean:
+        return JSON(value_bool());
+      case NodeType::Number:
+        // Same type and text as JSON::parse would give.
+        if (tag() == SnapshotTag::NumberText)
+          return JSON::parse(numberText());
+        return is_double() ? JSON(value_double()) : JSON(value_int());
+      case NodeType::String:
+        return JSON(std::string(value_string()));
+      case NodeType::Array: {
+        Array::ArrayVT val;
+        val.reserve(size());
+        for (size_t i = 0; i < size(); i++)
+          val.emplace_back((*this)[i].toJSON(dep + 1));
+        return JSON(std::make_unique<Array>(std::move(val)));
+      }
+      case NodeType::Object: {
+        Object::ObjectVT val;
+        val.reserve(size());
+        for (size_t i = 0; i < size(); i++)
+          val.insert({std::string(keyAt(i)), valueAt(i).toJSON(dep + 1)});
+        return JSON(std::make_unique<Object>(std::move(val)));
+      }
+      }
+      throw JSONException("unreachable: a JSON::Node has no nodetype");
+    }
+  };
+
+private:
+  // Compile-time parser behind the _cjson literal. It accepts strict RFC 8259
+  // JSON and writes snapshot records directly, so no tree is ever built.
+  // Errors call the non-constexpr getJSONParseError, which turns malformed
+  // input into a compile error pointing at the failed expectation.
+  inline static constexpr void staticRemoveWhiteSpaces(std::string_view &sv) {
+    while (!sv.empty() &&
+           (sv[0] == ' ' || sv[0] == '\n' || sv[0] == '\r' || sv[0] == '\t'))
+      sv.remove_prefix(1);
+  }
+
+  inline static constexpr void staticExpect(std::string_view &sv,
+                                            std::string_view token,
+                                            const char *excepted) {
+    if (!sv.starts_with(token))
+      throw getJSONParseError(sv, excepted);
+    sv.remove_prefix(token.size());
+  }
+
+  inline static constexpr void staticPushUtf8(std::string &utf8,
+                                              uint32_t codepoint) {
+    if (codepoint <= 0x7F) {
+      utf8 += static_cast<char>(codepoint);
+    } else if (codepoint <= 0x7FF) {
+      utf8 += static_cast<char>(0xC0 | (codepoint >> 6));
+      utf8 += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else if (codepoint <= 0xFFFF) {
+      utf8 += static_cast<char>(0xE0 | (codepoint >> 12));
+      utf8 += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+      utf8 += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else {
+      utf8 += static_cast<char>(0xF0 | (codepoint >> 18));
+      utf8 += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+      utf8 += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+      utf8 += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+  }
+
+  inline static constexpr uint32_t staticParseHex4(std::string_view &sv) {
+    if (sv.size() < 4)
+      throw getJSONParseError(sv, "[0-9a-fA-F] but got bad Unicode escape");
+    uint32_t res = 0;
+    for (int i = 0; i < 4; i++) {
+      char c = sv[i];
+      uint32_t digit = c >= '0' && c <= '9'   ? c - '0'
+                       : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                       : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                              : 16;
+      if (digit == 16)
+        throw getJSONParseError(sv, "[0-9a-fA-F] but got bad Unicode escape");
+      res = res * 16 + digit;
+    }
+    sv.remove_prefix(4);
+    return res;
+  }
+
+  static constexpr std::string staticParseString(std::string_view &sv) {
+    staticExpect(sv, "\"", "string start `\"`");
+    std::string res;
+    while (true) {
+      if (sv.empty())
+        throw getJSONParseError(sv, "string end `\"`");
+      char c = sv[0];
+      sv.remove_prefix(1);
+      if (c == '"')
+        return res;
+      if (static_cast<uint8_t>(c) < 0x20)
+        throw getJSONParseError(sv, "no control char in string");
+      if (c != '\\') {
+        res += c;
+        continue;
+      }
+      if (sv.empty())
+        throw getJSONParseError(sv, "escape character");
+      c = sv[0];
+      sv.remove_prefix(1);
+      switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+        res += c;
+        break;
+      case 'b':
+        res += '\b';
+        break;
+      case 'f':
+        res += '\f';
+        break;
+      case 'n':
+        res += '\n';
+        break;
+      case 'r':
+        res += '\r';
+        break;
+      case 't':
+        res += '\t';
+        break;
+      case 'u':
+        // Each escape is encoded on its own, surrogates included, exactly
+        // as String::parseString does.
+        staticPushUtf8(res, staticParseHex4(sv));
+        break;
+      default:
+        throw getJSONParseError(sv, "escape character");
+      }
+    }
+  }
+
+  inline static constexpr bool staticIsDigit(std::string_view sv) {
+    return !sv.empty() && sv[0] >= '0' && sv[0] <= '9';
+  }
+
+  // Whether `sv` is exactly one number in the JSON grammar.
+  inline static constexpr bool isNumberLiteral(std::string_view sv) {
+    auto digits = [&sv] {
+      size_t n = 0;
+      while (staticIsDigit(sv.substr(n)))
+        n++;
+      sv.remove_prefix(n);
+      return n != 0;
+    };
+    if (sv.starts_with('-'))
+      sv.remove_prefix(1);
+    if (sv.starts_with('0'))
+      sv.remove_prefix(1);
+    else if (!digits())
+      return false;
+    if (sv.starts_with('.')) {
+      sv.remove_prefix(1);
+      if (!digits())
+        return false;
+    }
+    if (sv.starts_with('e') || sv.starts_with('E')) {
+      sv.remove_prefix(1);
+      if (sv.starts_with('+') || sv.starts_with('-'))
+        sv.remove_prefix(1);
+      if (!digits())
+        return false;
+    }
+    return sv.empty();
+  }
+
+  // Decimal digits of factor * base^n, most significant first.
+  static constexpr std::string staticPowDigits(uint64_t factor, unsigned base,
+                                               int n) {
+    std::string res;
+    for (; factor != 0; factor /= 10)
+      res += static_cast<char>('0' + factor % 10);
+    while (n > 0) {
+      // Multiply by as large a power of base as fits, to stay well inside
+      // the compiler's constant evaluation limits.
+      uint64_t mul = 1;
+      for (; n > 0 && mul * base <= UINT32_MAX; n--)
+        mul *= base;
+      uint64_t carry = 0;
+      for (auto &c : res) {
+        uint64_t d = (c - '0') * mul + carry;
+        c = static_cast<char>('0' + d % 10);
+        carry = d / 10;
+      }
+      for (; carry != 0; carry /= 10)
+        res += static_cast<char>('0' + carry % 10);
+    }
+    std::reverse(res.begin(), res.end());
+    return res;
+  }
+
+  // Whether std::stod, and so JSON::parse, accepts a number literal. It fails
+  // from DBL_MAX plus half an ulp up and for nonzero values below DBL_MIN
+  // minus 2^-1076, so compare the digits against those two bounds.
+  static constexpr bool staticInDoubleRange(std::string_view literal) {
+    // Significant digits and the decimal exponent of the first one.
+    std::string digits;
+    int64_t int_digits = 0, skipped = 0;
+    bool point = false;
+    size_t i = literal.starts_with('-') ? 1 : 0;
+    for (; i < literal.size() && literal[i] != 'e' && literal[i] != 'E'; i++) {
+      if (literal[i] == '.') {
+        point = true;
+        continue;
+      }
+      if (!point)
+        int_digits++;
+      if (digits.empty() && literal[i] == '0')
+        skipped++;
+      else
+        digits += literal[i];
+    }
+    if (digits.empty())
+      return true;
+    while (digits.back() == '0')
+      digits.pop_back();
+    int64_t exp = 0;
+    bool negative_exp = false;
+    if (i < literal.size()) {
+      i++;
+      negative_exp = literal[i] == '-';
+      for (; i < literal.size(); i++) {
+        if (literal[i] >= '0' && literal[i] <= '9')
+          exp = std::min<int64_t>(exp * 10 + (literal[i] - '0'), 1000000);
+      }
+    }
+    auto e10 = int_digits - skipped - 1 + (negative_exp ? -exp : exp);
+    constexpr uint64_t mantissa = (uint64_t{1} << 54) - 1;
+    if (e10 == 308) // (2^54 - 1) * 2^970, 309 digits
+      return digits < staticPowDigits(mantissa, 2, 970);
+    if (e10 == -308) // (2^54 - 1) * 5^1076 / 10^1076, 769 digits
+      return !(digits < staticPowDigits(mantissa, 5, 1076));
+    return e10 > -308 && e10 < 308;
+  }
+
+  static constexpr uint64_t staticParseNumber(std::string_view &sv,
+                                              std::string &out) {
+    auto literal = sv;
+    bool negative = sv.starts_with('-');
+    if (negative)
+      sv.remove_prefix(1);
+    if (!staticIsDigit(sv))
+      throw getJSONParseError(sv, "digit");
+
+    // Magnitude of the integer part, saturated once it leaves int64_t.
+    constexpr uint64_t limit = uint64_t{1} << 63;
+    uint64_t magnitude = 0;
+    bool integral = true;
+    if (sv[0] == '0') {
+      sv.remove_prefix(1);
+    } else {
+      while (staticIsDigit(sv)) {
+        uint64_t digit = sv[0] - '0';
+        magnitude = magnitude > (limit - digit) / 10 ? limit + 1
+                                                     : magnitude * 10 + digit;
+        sv.remove_prefix(1);
+      }
+    }
+    if (sv.starts_with('.')) {
+      integral = false;
+      sv.remove_prefix(1);
+      if (!staticIsDigit(sv))
+        throw getJSONParseError(sv, "digit after `.`");
+      while (staticIsDigit(sv))
+        sv.remove_prefix(1);
+    }
+    if (sv.starts_with('e') || sv.starts_with('E')) {
+      integral = false;
+      sv.remove_prefix(1);
+      if (sv.starts_with('+') || sv.starts_with('-'))
+        sv.remove_prefix(1);
+      if (!staticIsDigit(sv))
+        throw getJSONParseError(sv, "digit in exponent");
+      while (staticIsDigit(sv))
+        sv.remove_prefix(1);
+    }
+
+    uint64_t off = out.size();
+    // -0 stays text so that dumping it keeps the sign.
+    if (integral && magnitude <= limit - (negative ? 0 : 1) &&
+        !(negative && magnitude == 0)) {
+      out += static_cast<char>(SnapshotTag::Int);
+      putLittleEndian(out, negative ? ~magnitude + 1 : magnitude, 8);
+    } else {
+      literal = literal.substr(0, literal.size() - sv.size());
+      if (!staticInDoubleRange(literal))
+        throw getJSONParseError(sv, "but got out of range");
+      out += static_cast<char>(SnapshotTag::NumberText);
+      putLittleEndian(out, literal.size(), 8);
+      // Char by char: GCC 12 can not append a view into a template parameter
+      // object during constant evaluation.
+      for (char c : literal)
+        out += c;
+    }
+    return off;
+  }
+
+  static constexpr uint64_t staticParseValue(std::string_view &sv,
+                                             std::string &out, int dep) {
+    if (dep > MAX_RECURSE_DEPTH)
+      throw getJSONParseError(sv, ".., max rescurse depth exceeded");
+    staticRemoveWhiteSpaces(sv);
+    uint64_t off = out.size();
+    switch (sv.empty() ? '\0' : sv[0]) {
+    case 'n':
+      staticExpect(sv, "null", "`null`");
+      out += static_cast<char>(SnapshotTag::Null);
+      return off;
+    case 't':
+      staticExpect(sv, "true", "`true` or `false`");
+      out += static_cast<char>(SnapshotTag::True);
+      return off;
+    case 'f':
+      staticExpect(sv, "false", "`true` or `false`");
+      out += static_cast<char>(SnapshotTag::False);
+      return off;
+    case '"':
+      return snapshotPutString(out, staticParseString(sv));
+    case '[': {
+      sv.remove_prefix(1);
+      std::vector<uint64_t> children;
+      staticRemoveWhiteSpaces(sv);
+      if (sv.starts_with(']')) {
+        sv.remove_prefix(1);
+      } else {
+        while (true) {
+          children.push_back(staticParseValue(sv, out, dep + 1));
+          staticRemoveWhiteSpaces(sv);
+          if (sv.starts_with(']')) {
+            sv.remove_prefix(1);
+            break;
+          }
+          staticExpect(sv, ",", "array spliter `,` or array end `]`");
+        }
+      }
+      off = out.size();
+      out += static_cast<char>(SnapshotTag::Array);
+      putLittleEndian(out, children.size(), 8);
+      for (auto child : children)
+        putLittleEndian(out, child, 8);
+      return off;
+    }
+    case '{': {
+      sv.remove_prefix(1);
+      std::vector<std::pair<uint64_t, uint64_t>> entries;
+      staticRemoveWhiteSpaces(sv);
+      if (sv.starts_with('}')) {
+        sv.remove_prefix(1);
+      } else {
+        while (true) {
+          staticRemoveWhiteSpaces(sv);
+          auto key_off = snapshotPutString(out, staticParseString(sv));
+          staticRemoveWhiteSpaces(sv);
+          staticExpect(sv, ":", "object spliter `:`");
+          entries.emplace_back(key_off, staticParseValue(sv, out, dep + 1));
+          staticRemoveWhiteSpaces(sv);
+          if (sv.starts_with('}')) {
+            sv.remove_prefix(1);
+            break;
+          }
+          staticExpect(sv, ",", "object spliter `,` or object end `}`");
+        }
+      }
+      return snapshotPutObject(out, entries);
+    }
+    default:
+      if (sv.starts_with('-') || staticIsDigit(sv))
+        return staticParseNumber(sv, out);
+      throw getJSONParseError(sv, "any JSON value");
+    }
+  }
+
+public:
+  // A string literal that can be passed as a template argument.
+  template <size_t N> struct FixedString {
+    char data[N]{};
+    consteval FixedString(const char (&str)[N]) { std::copy_n(str, N, data); }
+    constexpr std::string_view view() const { return {data, N - 1}; }
+  };
+
+  // A document parsed at compile time, stored as snapshot bytes that live in
+  // the binary's read-only data.
+  template <size_t N> struct StaticJSON {
+    std::array<char, N> bytes{};
+
+    constexpr SnapshotView view() const {
+      return SnapshotView::open(std::string_view(bytes.data(), N));
+    }
+    JSON toJSON() const { return view().toJSON(); }
+  };
+
+  // Builds the snapshot of JSON text with the compile-time parser. Usable at
+  // run time too, but mostly here for parseStatic and the _cjson literal.
+  static constexpr std::string staticSnapshot(std::string_view sv) {
+    std::string out(SNAPSHOT_MAGIC);
+    putLittleEndian(out, 0, 8);
+    auto root = staticParseValue(sv, out, 0);
+    staticRemoveWhiteSpaces(sv);
+    if (!sv.empty())
+      throw getJSONParseError(sv, "EOF");
+    patchLittleEndian(out, SNAPSHOT_MAGIC.size(), root, 8);
+    return out;
+  }
+
+  template <FixedString S> static consteval auto parseStatic() {
+    StaticJSON<staticSnapshot(S.view()).size()> res;
+    auto bytes = staticSnapshot(S.view());
+    std::copy(bytes.begin(), bytes.end(), res.bytes.begin());
+    return res;
+  }
+
+private:
+  inline static JSONSchemaException getSchemaError(std::string_view sv,
+                                                   const ParseContext &ctx,
+                                                   const std::string &what) {
+    auto offset = static_cast<size_t>(sv.data() - ctx.begin);
+    return JSONSchemaException(
+        std::format("Schema violation at offset {}: {}", offset, what),
+        offset);
+  }
+
+  // Bit of a JSON Schema "type" name. "integer" gets a bit of its own.
+  inline static constexpr unsigned schemaTypeBit(NodeType type) {
+    return 1u << static_cast<unsigned>(type);
+  }
+  static constexpr unsigned SCHEMA_INTEGER_BIT = 1u << 6;
+
+  // Rejects a value by its first character, before anything is built.
+  static void checkSchemaType(std::string_view sv, const ParseContext &ctx,
+                              const SchemaRule &rule) {
+    NodeType type;
+    switch (sv.empty() ? '\0' : sv[0]) {
+    case 'n':
+      type = NodeType::Null;
+      break;
+    case 't':
+    case 'f':
+      type = NodeType::Boolean;
+      break;
+    case '"':
+      type = NodeType::String;
+      break;
+    case '[':
+      type = NodeType::Array;
+      break;
+    case '{':
+      type = NodeType::Object;
+      break;
+    default:
+      // Not a value at all; let the parser report the syntax error.
+      if (sv.empty() || (sv[0] != '-' && (sv[0] < '0' || sv[0] > '9')))
+        return;
+      type = NodeType::Number;
+      if (rule.types & SCHEMA_INTEGER_BIT)
+        return;
+    }
+    if (!(rule.types & schemaTypeBit(type)))
+      throw getSchemaError(sv, ctx, "value has a type the schema forbids");
+  }
+
+  inline static bool schemaScalarEquals(const Node &a, const Node &b) {
+    if (a.getType() != b.getType())
+      return false;
+    switch (a.getType()) {
+    case NodeType::Null:
+      return true;
+    case NodeType::Boolean:
+      return a.cast<Boolean>().value() == b.cast<Boolean>().value();
+    case NodeType::Number:
+      return a.cast<Number>().value_double() == b.cast<Number>().value_double();
+    case NodeType::String:
+      return a.cast<String>().value() == b.cast<String>().value();
+    default:
+      return false;
+    }
+  }
+
+  // Checks what can only be checked once the value is built.
+  static void checkSchemaValue(std::string_view sv, const ParseContext &ctx,
+                               const SchemaRule &rule, const Node &node) {
+    bool integer_only = !(rule.types & schemaTypeBit(NodeType::Number));
+    // Lazy numbers stay unconverted unless a keyword needs the value.
+    if (node.getType() == NodeType::Number &&
+        (integer_only || rule.minimum || rule.maximum)) {
+      auto v = node.cast<Number>().value_double();
+      if (integer_only && std::trunc(v) != v)
+        throw getSchemaError(sv, ctx, "number is not an integer");
+      if (rule.minimum && v < *rule.minimum)
+        throw getSchemaError(sv, ctx, "number is below minimum");
+      if (rule.maximum && v > *rule.maximum)
+        throw getSchemaError(sv, ctx, "number is above maximum");
+    }
+    if (node.getType() == NodeType::String && rule.max_length) {
+      // Length counts code points, i.e. every byte but UTF-8 continuations.
+      auto len = std::ranges::count_if(node.cast<String>().value(), [](char c) {
+        return (static_cast<uint8_t>(c) & 0xC0) != 0x80;
+      });
+      if (static_cast<size_t>(len) > *rule.max_length)
+        throw getSchemaError(sv, ctx, "string is longer than maxLength");
+    }
+    if (!rule.enum_values.empty() &&
+        std::ranges::none_of(rule.enum_values, [&node](const JSON &v) {
+          return schemaScalarEquals(*v._uptr, node);
+        }))
+      throw getSchemaError(sv, ctx, "value is not in enum");
+  }
+
+  // Finds the rule of an object member and records required names.
+  static size_t schemaMemberRule(std::string_view sv, const ParseContext &ctx,
+                                 const SchemaRule &rule, const std::string &key,
+                                 uint64_t &seen_required) {
+    auto it = rule.properties.find(key);
+    if (it != rule.properties.end()) {
+      if (it->second.required_bit != NO_SCHEMA_RULE)
+        seen_required |= uint64_t{1} << it->second.required_bit;
+      if (it->second.declared)
+        return it->second.rule;
+    }
+    if (!rule.additional_allowed)
+      throw getSchemaError(sv, ctx,
+                           "property `" + key + "` is not allowed by schema");
+    return rule.additional;
+  }
+
+  static void checkSchemaRequired(std::string_view sv, const ParseContext &ctx,
+                                  const SchemaRule &rule,
+                                  uint64_t seen_required) {
+    for (size_t i = 0; i < rule.required.size(); i++) {
+      if (!(seen_required & (uint64_t{1} << i)))
+        throw getSchemaError(sv, ctx,
+                             "missing required property `" + rule.required[i] +
+                                 "`");
+    }
+  }
+
+  // Steps over a value the schema skips. Syntax is checked like the parser
+  // does, but nothing is allocated.
+  static void skipValue(std::string_view &sv, int dep) {
+    assert_depth(sv, dep);
+    removeWhiteSpaces(sv);
+    switch (sv[0]) {
+    case 'n':
+      if (!sv.starts_with("null"))
+        throw getJSONParseError(sv, "`null`");
+      sv.remove_prefix(4);
+      return;
+    case 't':
+      if (!sv.starts_with("true"))
+        throw getJSONParseError(sv, "`true` or `false`");
+      sv.remove_prefix(4);
+      return;
+    case 'f':
+      if (!sv.starts_with("false"))
+        throw getJSONParseError(sv, "`true` or `false`");
+      sv.remove_prefix(5);
+      return;
+    case '"':
+      skipString(sv);
+      return;
+    case '[':
+    case '{': {
+      char close = sv[0] == '[' ? ']' : '}';
+      sv.remove_prefix(1);
+      removeWhiteSpaces(sv);
+      if (sv[0] == close) {
+        sv.remove_prefix(1);
+        return;
+      }
+      while (true) {
+        if (close == '}') {
+          removeWhiteSpaces(sv);
+          skipString(sv);
+          removeWhiteSpaces(sv);
+          if (sv[0] != ':')
+            throw getJSONParseError(sv, "object spliter `:`");
+          sv.remove_prefix(1);
+        }
+        skipValue(sv, dep + 1);
+        removeWhiteSpaces(sv);
+        if (sv[0] == close) {
+          sv.remove_prefix(1);
+          return;
+        }
+        if (sv[0] != ',')
+          throw getJSONParseError(sv, "spliter `,` or container end");
+        sv.remove_prefix(1);
+        removeWhiteSpaces(sv);
+        if (sv[0] == close && !ENABLE_TRAILING_COMMA)
+          throw getJSONParseError(sv, "next json value");
+      }
+    }
+    default: {
+      auto digits = sv.substr(sv.starts_with('-') ? 1 : 0);
+      if (digits.empty() || digits[0] < '0' || digits[0] > '9')
+        throw getJSONParseError(sv, "any JSON value");
+      auto ptr = std::ranges::find_if_not(sv, [](char c) {
+        return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == 'e' ||
+               c == 'E' || c == '.';
+      });
+      sv.remove_prefix(ptr - sv.begin());
+      return;
+    }
+    }
+  }
+
+  static void skipString(std::string_view &sv) {
+    if (sv[0] != '"')
+      throw getJSONParseError(sv, "string start `\"`");
+    sv.remove_prefix(1);
+    while (true) {
+      auto ptr = std::ranges::find_if(
+          sv, [](char c) { return c == '\\' || c == '"'; });
+      auto n = static_cast<size_t>(ptr - sv.begin());
+      for (auto c : sv.substr(0, n)) {
+        switch (c) {
+        case '\n':
+          throw getJSONParseError(sv, "string end `\"`");
+        case '\t':
+        case '\0':
+          throw getJSONParseError(sv, "no control char in string");
+        }
+      }
+      sv.remove_prefix(n);
+      if (sv.empty())
+        throw getJSONParseError(sv, "string end `\"`");
+      if (sv[0] == '"') {
+        sv.remove_prefix(1);
+        return;
+      }
+      sv.remove_prefix(1);
+      switch (sv[0]) {
+      case '\\':
+      case '"':
+      case '/':
+      case 'b':
+      case 'f':
+      case 'n':
+      case 'r':
+      case 't':
+        sv.remove_prefix(1);
+        break;
+      case 'u':
+        sv.remove_prefix(1);
+        for (auto c : sv.substr(0, 4)) {
+          if (not((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F') ||
+                  (c >= '0' && c <= '9')))
+            throw getJSONParseError(sv,
+                                    "[0-9a-fA-F] but got bad Unicode escape");
+        }
+        sv.remove_prefix(std::min<size_t>(4, sv.size()));
+        break;
+      default:
+        throw getJSONParseError(sv, "escape character");
+      }
+    }
+  }
+
+public:
+  // A JSON Schema subset compiled for validation inside JSON::parse:
+  // type (including "integer"), properties, required, additionalProperties,
+  // items, enum (of scalars), minimum, maximum and maxLength. Unknown
+  // keywords are ignored. The extension keyword "x-skip": true marks a
+  // subschema whose values are checked for syntax only and left out of the
+  // tree.
+  class Schema {
+    friend class JSON;
+    std::vector<SchemaRule> rules_{};
+
+    static const Object &asObject(const Node &node, const char *what) {
+      if (node.getType() != NodeType::Object)
+        throw JSONException(std::format("schema: {} must be an object", what));
+      return node.cast<Object>();
+    }
+
+    static unsigned typeBit(const Node &node) {
+      if (node.getType() != NodeType::String)
+        throw JSONException("schema: type names must be strings");
+      const auto &name = node.cast<String>().value();
+      if (name == "null")
+        return schemaTypeBit(NodeType::Null);
+      if (name == "boolean")
+        return schemaTypeBit(NodeType::Boolean);
+      if (name == "number")
+        return schemaTypeBit(NodeType::Number);
+      if (name == "integer")
+        return SCHEMA_INTEGER_BIT;
+      if (name == "string")
+        return schemaTypeBit(NodeType::String);
+      if (name == "array")
+        return schemaTypeBit(NodeType::Array);
+      if (name == "object")
+        return schemaTypeBit(NodeType::Object);
+      throw JSONException(std::format("schema: unknown type `{}`", name));
+    }
+
+    static double number(const Node &node, const char *what) {
+      if (node.getType() != NodeType::Number)
+        throw JSONException(std::format("schema: {} must be a number", what));
+      return node.cast<Number>().value_double();
+    }
+
+    // Compiles `node` and returns its index in rules_.
+    size_t compileRule(const Node &node) {
+      auto idx = rules_.size();
+      rules_.emplace_back();
+      SchemaRule rule;
+      if (node.getType() == NodeType::Boolean) {
+        // `true` accepts everything, `false` nothing.
+        if (!node.cast<Boolean>().value())
+          rule.types = 0;
+        rules_[idx] = std::move(rule);
+        return idx;
+      }
+      for (const auto &[key, val] : asObject(node, "a schema").value()) {
+        const auto &v = *val._uptr;
+        if (key == "type") {
+          rule.types = 0;
+          if (v.getType() == NodeType::Array) {
+            for (const auto &t : v.cast<Array>().value())
+              rule.types |= typeBit(*t._uptr);
+          } else {
+            rule.types = typeBit(v);
+          }
+        } else if (key == "properties") {
+          for (const auto &[name, sub] : asObject(v, "properties").value()) {
+            auto &prop = rule.properties[name];
+            prop.declared = true;
+            prop.rule = compileRule(*sub._uptr);
+          }
+        } else if (key == "required") {
+          if (v.getType() != NodeType::Array)
+            throw JSONException("schema: required must be an array");
+          for (const auto &name : v.cast<Array>().value()) {
+            if (name->getType() != NodeType::String)
+              throw JSONException("schema: required names must be strings");
+            rule.required.push_back(name->cast<String>().value());
+          }
+        } else if (key == "additionalProperties") {
+          if (v.getType() == NodeType::Boolean)
+            rule.additional_allowed = v.cast<Boolean>().value();
+          else
+            rule.additional = compileRule(v);
+        } else if (key == "items") {
+          rule.items = compileRule(v);
+        } else if (key == "enum") {
+          if (v.getType() != NodeType::Array)
+            throw JSONException("schema: enum must be an array");
+          for (const auto &e : v.cast<Array>().value()) {
+            if (e->getType() == NodeType::Array ||
+                e->getType() == NodeType::Object)
+              throw JSONException("schema: only scalar enum values are "
+                                  "supported");
+            rule.enum_values.push_back(JSON::parse(e->dump()));
+          }
+        } else if (key == "minimum") {
+          rule.minimum = number(v, "minimum");
+        } else if (key == "maximum") {
+          rule.maximum = number(v, "maximum");
+        } else if (key == "maxLength") {
+          rule.max_length = static_cast<size_t>(number(v, "maxLength"));
+        } else if (key == "x-skip") {
+          rule.skip = v.getType() == NodeType::Boolean &&
+                      v.cast<Boolean>().value();
+        }
+      }
+      if (rule.required.size() > 64)
+        throw JSONException("schema: at most 64 required properties");
+      for (size_t i = 0; i < rule.required.size(); i++)
+        rule.properties[rule.required[i]].required_bit = i;
+      rules_[idx] = std::move(rule);
+      return idx;
+    }
+
+  public:
+    static Schema compile(const JSON &schema) {
+      Schema res;
+      // A skipped root would leave JSON::parse nothing to return.
+      if (res.rules_[res.compileRule(*schema._uptr)].skip)
+        throw JSONException("schema: x-skip is not allowed on the root");
+      return res;
+    }
+    static Schema compile(std::string_view schema_text) {
+      return compile(JSON::parse(schema_text));
+    }
+  };
+
+public:
+  static JSON parse(std::string_view sv) { return parse(sv, ParseOptions{}); }
+
+  static JSON parse(std::string_view sv, const ParseOptions &opts) {
+    ParseScratch scratch;
+    ParseContext ctx{opts, scratch};
+    if (opts.schema != nullptr) {
+      ctx.rules = opts.schema->rules_.data();
+      ctx.rule = 0;
+      ctx.begin = sv.data();
+    }
+    auto res = Node::parse(sv, 0, ctx);
     removeWhiteSpaces(sv);
     if (!sv.empty()) {
       throw getJSONParseError(sv, "EOF");
     }
     return JSON(std::move(res));
   }
-};
\ No newline at end of file
+};
+
+namespace json_literals {
+// R"({"retries":3})"_cjson is parsed and validated by the compiler.
+template <JSON::FixedString S> consteval auto operator""_cjson() {
+  return JSON::parseStatic<S>();
+}
+} // namespace json_literals
@@ -0,0 +1,80 @@
+// Checks of the compile-time parser. Everything here is verified by the
+// compiler; the program itself only compares the literals with JSON::parse.
+#include "cppjson.h"
+#include <iostream>
+#include <string_view>
+#include <type_traits>
+
+using namespace json_literals;
+
+// Whether S is accepted by the compile-time parser.
+template <JSON::FixedString S>
+constexpr bool compiles = requires {
+  typename std::integral_constant<size_t,
+                                  JSON::staticSnapshot(S.view()).size()>;
+};
+
+constexpr auto config = R"({"retries": 3, "hosts": ["a", "b"], "ratio": 0.5,
+                            "big": 9223372036854775808, "neg": -0})"_cjson;
+
+static_assert(config.view().size() == 5);
+static_assert(config.view().keyAt(0) == "big");
+static_assert(config.view().find("retries")->value_int() == 3);
+static_assert(!config.view().find("retries")->is_double());
+static_assert(config.view().find("hosts")->size() == 2);
+static_assert(config.view().find("hosts")->operator[](1).value_string() == "b");
+static_assert(config.view().find("ratio")->is_double());
+static_assert(config.view().find("big")->is_double());
+static_assert(!config.view().find("neg")->is_double());
+static_assert(config.view().find("neg")->value_int() == 0);
+static_assert(!config.view().find("missing"));
+
+static_assert(compiles<"[0, -1, 1.5e3, \"\\u00e9\", true, null, {}]">);
+static_assert(compiles<"-9223372036854775808">);
+static_assert(!compiles<"[1,]">);
+static_assert(!compiles<"{\"a\" 1}">);
+static_assert(!compiles<"01">);
+static_assert(!compiles<"1.">);
+static_assert(!compiles<"\"\\x\"">);
+static_assert(!compiles<"[] []">);
+
+// Literals JSON::parse rejects as out of range do not compile either.
+static_assert(compiles<"1.7976931348623157e308">);
+static_assert(compiles<"1.7976931348623158e308">);
+static_assert(!compiles<"1.7976931348623159e308">);
+static_assert(!compiles<"1e400">);
+static_assert(!compiles<"-1e309">);
+static_assert(!compiles<"18000000000000000000e290">);
+static_assert(compiles<"2.2250738585072014e-308">);
+static_assert(compiles<"2.2250738585072013e-308">);
+static_assert(!compiles<"2.225073858507201e-308">);
+static_assert(!compiles<"1e-400">);
+static_assert(!compiles<"0.00001e-304">);
+static_assert(compiles<"0e999">);
+static_assert(compiles<"-0.0e-999">);
+
+int main() {
+  // The literal converts to the tree JSON::parse builds from the same text.
+  constexpr std::string_view text =
+      R"({"big":9223372036854775808,"hosts":["a","b"],"neg":-0,)"
+      R"("ratio":0.5,"retries":3,"tiny":2.2250738585072014e-308})";
+  constexpr auto literal =
+      R"({"big":9223372036854775808,"hosts":["a","b"],"neg":-0,)"
+      R"("ratio":0.5,"retries":3,"tiny":2.2250738585072014e-308})"_cjson;
+  auto expected = JSON::parse(text), got = literal.toJSON();
+  auto &neg = got->cast<JSON::Object>()["neg"]->cast<JSON::Number>();
+  // Escaped surrogates are decoded one escape at a time by both parsers.
+  constexpr auto pair = R"(["\uD83D\uDE00", "\uDE00"])"_cjson;
+  auto pair_expected = JSON::parse(R"(["\uD83D\uDE00", "\uDE00"])");
+  auto pair_got = pair.toJSON();
+  auto &want = pair_expected->cast<JSON::Array>();
+  auto &have = pair_got->cast<JSON::Array>();
+  bool ok = literal.view().dump() == text && !neg.is_double() &&
+            neg.value_int() == 0 && got->dump() == expected->dump() &&
+            have[0]->cast<JSON::String>().value() ==
+                want[0]->cast<JSON::String>().value() &&
+            have[1]->cast<JSON::String>().value() ==
+                want[1]->cast<JSON::String>().value();
+  std::cout << (ok ? "static checks passed" : "static checks FAILED") << "\n";
+  return ok ? 0 : 1;
+}
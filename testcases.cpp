@@ -1,11 +1,13 @@
 #include "cppjson.h"
 #include "nlohmann-json/json.hpp"
 #include <algorithm>
+#include <cmath>
 #include <exception>
 #include <filesystem>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -37,6 +39,213 @@ std::string readfile(const std::string &path) {
 
 bool show_detailed = false;
 
+// Behaviour checks of the library itself. A check passes when it returns
+// true without throwing.
+using Checks = std::vector<std::pair<std::string, std::function<bool()>>>;
+
+Result check(std::string test_name, const Checks &checks) {
+  int pass = 0, fail = 0;
+  for (const auto &[name, fn] : checks) {
+    bool ok = false;
+    std::string error;
+    try {
+      ok = fn();
+    } catch (const std::exception &e) {
+      error = (&e)->what();
+    }
+    if (ok) {
+      pass++;
+      if (show_detailed)
+        std::cout << "\033[32m[PASS]:\033[0m " << test_name << ": " << name
+                  << std::endl;
+    } else {
+      fail++;
+      std::cout << "\033[31m[FAIL]: " << test_name << ": " << name
+                << "\033[0m " << error << std::endl;
+    }
+  }
+  return {std::move(test_name), pass, fail};
+}
+
+template <typename E = JSON::JSONException>
+bool throws(const std::function<void()> &fn) {
+  try {
+    fn();
+  } catch (const E &) {
+    return true;
+  }
+  return false;
+}
+
+// Structural equality. Objects are compared by key, since two maps with the
+// same members may iterate in different orders.
+bool sameTree(const JSON &a, const JSON &b) {
+  if (a->getType() != b->getType())
+    return false;
+  switch (a->getType()) {
+  case JSON::NodeType::Null:
+    return true;
+  case JSON::NodeType::Boolean:
+    return a->cast<JSON::Boolean>().value() == b->cast<JSON::Boolean>().value();
+  case JSON::NodeType::Number: {
+    const auto &x = a->cast<JSON::Number>(), &y = b->cast<JSON::Number>();
+    return x.is_double() == y.is_double() &&
+           (x.is_double() ? x.value_double() == y.value_double()
+                          : x.value_int() == y.value_int());
+  }
+  case JSON::NodeType::String:
+    return a->cast<JSON::String>().value() == b->cast<JSON::String>().value();
+  case JSON::NodeType::Array: {
+    const auto &x = a->cast<JSON::Array>().value();
+    const auto &y = b->cast<JSON::Array>().value();
+    return std::ranges::equal(x, y, sameTree);
+  }
+  case JSON::NodeType::Object: {
+    const auto &x = a->cast<JSON::Object>().value();
+    const auto &y = b->cast<JSON::Object>().value();
+    return x.size() == y.size() &&
+           std::ranges::all_of(x, [&y](const auto &member) {
+             auto it = y.find(member.first);
+             return it != y.end() && sameTree(member.second, it->second);
+           });
+  }
+  }
+  return false;
+}
+
+Checks dumpCacheChecks() {
+  const std::string text =
+      R"({"a":[1,{"b":[2,3]},"s"],"c":{"d":{"e":true}},"f":1.5,"g":"x"})";
+  // Compares the cached dump of `json` with a plain dump after `mutate`.
+  auto same = [](JSON &json, JSON::DumpCache &cache) {
+    return cache.dump(json) == json->dump();
+  };
+  return {
+      {"first dump equals plain dump",
+       [=] {
+         auto json = JSON::parse(text);
+         JSON::DumpCache cache;
+         return same(json, cache) && cache.dump(json) == cache.str();
+       }},
+      {"slot assignment",
+       [=] {
+         auto json = JSON::parse(text);
+         JSON::DumpCache cache;
+         cache.dump(json);
+         auto &a = json->cast<JSON::Object>()["a"]->cast<JSON::Array>();
+         a[1]->cast<JSON::Object>()["b"] = "replaced";
+         return same(json, cache) &&
+                cache.str().find("\"replaced\"") != std::string::npos;
+       }},
+      {"Number::set",
+       [=] {
+         auto json = JSON::parse(text);
+         JSON::DumpCache cache;
+         cache.dump(json);
+         auto &b = json->cast<JSON::Object>()["a"]->cast<JSON::Array>()[1];
+         b->cast<JSON::Object>()["b"]->cast<JSON::Array>()[0]
+             ->cast<JSON::Number>()
+             .set(int64_t{42});
+         return same(json, cache) &&
+                cache.str().find("[42,3]") != std::string::npos;
+       }},
+      {"String::set and String::take",
+       [=] {
+         auto json = JSON::parse(text);
+         JSON::DumpCache cache;
+         cache.dump(json);
+         auto &g = json->cast<JSON::Object>()["g"]->cast<JSON::String>();
+         g.set(std::string("y"));
+         if (!same(json, cache))
+           return false;
+         auto taken = g.take();
+         return taken == "y" && same(json, cache);
+       }},
+      {"subtree moved out and back in",
+       [=] {
+         auto json = JSON::parse(text);
+         JSON::DumpCache cache;
+         cache.dump(json);
+         auto &root = json->cast<JSON::Object>();
+         JSON moved = std::move(root["c"]);
+         // A moved-from slot is empty until it is assigned again.
+         root["c"] = nullptr;
+         if (!same(json, cache))
+           return false;
+         // Reattached at a new position, its old ranges must not be used.
+         root["a"]->cast<JSON::Array>()[0] = std::move(moved);
+         if (!same(json, cache))
+           return false;
+         root["f"] = 2.5;
+         return same(json, cache);
+       }},
+      {"moved-out subtree dumps on its own",
+       [=] {
+         auto json = JSON::parse(text);
+         JSON::DumpCache cache, other;
+         cache.dump(json);
+         JSON c = std::move(json->cast<JSON::Object>()["c"]);
+         json->cast<JSON::Object>()["c"] = nullptr;
+         c->cast<JSON::Object>()["d"] = 1;
+         return other.dump(c) == R"({"d":1})" && same(json, cache);
+       }},
+      {"moved-from node",
+       [=] {
+         auto json = JSON::parse(text);
+         JSON::DumpCache cache;
+         cache.dump(json);
+         auto &root = json->cast<JSON::Object>();
+         JSON a(std::move(root["a"]->cast<JSON::Array>()));
+         if (!same(json, cache))
+           return false;
+         JSON g(std::move(root["g"]->cast<JSON::String>()));
+         if (!same(json, cache))
+           return false;
+         root["a"] = JSON::parse(R"([[1,2],[3],{"x":1},{"y":2}])");
+         cache.dump(json);
+         auto &arr = root["a"]->cast<JSON::Array>();
+         arr[0]->cast<JSON::Array>() = std::move(arr[1]->cast<JSON::Array>());
+         if (!same(json, cache))
+           return false;
+         cache.dump(json);
+         arr[2]->cast<JSON::Object>() = std::move(arr[3]->cast<JSON::Object>());
+         return same(json, cache);
+       }},
+      {"two caches on one document",
+       [=] {
+         auto json = JSON::parse(text);
+         JSON::DumpCache first, second;
+         first.dump(json);
+         json->cast<JSON::Object>()["f"] = 3;
+         second.dump(json);
+         json->cast<JSON::Object>()["g"] = 4;
+         return same(json, first) && same(json, second);
+       }},
+      {"subtree of a document falls back to a plain dump",
+       [=] {
+         auto json = JSON::parse(text);
+         JSON::DumpCache cache;
+         cache.dump(json);
+         auto &c = json->cast<JSON::Object>()["c"];
+         return cache.dump(c) == c->dump() && same(json, cache);
+       }},
+      {"cache is not kept in the tree",
+       [=] {
+         auto json = JSON::parse(text);
+         auto before = json->memoryUsage();
+         json->dump();
+         JSON::DumpCache cache;
+         cache.dump(json);
+         return json->memoryUsage() == before;
+       }},
+      {"scalars carry no cache",
+       [] {
+         return sizeof(JSON::Null) <= 2 * sizeof(void *) &&
+                sizeof(JSON::Boolean) <= 3 * sizeof(void *);
+       }},
+  };
+}
+
 Result
 test(std::string test_name,
      std::function<void(const std::string &filename, const std::string &s)>
@@ -105,6 +314,467 @@ test(std::string test_name,
   };
 }
 
+Checks numberChecks() {
+  auto number = [](std::string_view text, bool lazy) {
+    JSON::ParseOptions opts;
+    opts.lazy_numbers = lazy;
+    return JSON::parse(text, opts);
+  };
+  // Literals both modes accept, with their expected type.
+  const std::vector<std::pair<std::string_view, bool>> literals = {
+      {"0", false},
+      {"-0", false},
+      {"-1", false},
+      {"9223372036854775807", false},
+      {"-9223372036854775808", false},
+      {"9223372036854775808", true},
+      {"1.5", true},
+      {"-.5", true},
+      {"-2.25e3", true},
+      {"1e5", true},
+      {"1E2", true},
+      {"1e20", true},
+      {"1e-7", true},
+      {"123456.789012345", true},
+      {"1.7976931348623157e308", true},
+  };
+  Checks res;
+  for (const auto &[text, is_double] : literals) {
+    res.emplace_back("eager and lazy agree on " + std::string(text), [=] {
+      auto eager = number(text, false), lazy = number(text, true);
+      const auto &e = eager->cast<JSON::Number>();
+      const auto &l = lazy->cast<JSON::Number>();
+      // dump() echoes the literal without converting it.
+      return l.is_lazy() && lazy->dump() == text && l.is_lazy() &&
+             e.is_double() == is_double && l.is_double() == is_double &&
+             e.value_int() == l.value_int() &&
+             e.value_double() == l.value_double() &&
+             e.fits_int64() == l.fits_int64() && !l.is_lazy() &&
+             eager->dump() == text;
+    });
+  }
+  for (auto text :
+       {"1e400", "-1e400", "1e-400", "1.8e308", "-", "-.", "-.e5", "--1"}) {
+    res.emplace_back(std::string("both modes reject ") + text, [=] {
+      return throws<JSON::JSONParseException>([=] { number(text, false); }) &&
+             throws<JSON::JSONParseException>([=] { number(text, true); });
+    });
+  }
+  res.emplace_back("exponents are doubles", [=] {
+    const auto json = number("1e20", true);
+    const auto &n = json->cast<JSON::Number>();
+    return n.is_double() && n.value_double() == 1e20 && !n.fits_int64();
+  });
+  res.emplace_back("integral doubles fit int64_t", [=] {
+    const auto json = number("1e5", true);
+    const auto &n = json->cast<JSON::Number>();
+    return n.fits_int64() && n.value_int() == 100000;
+  });
+  res.emplace_back("copies and moves keep the literal", [=] {
+    auto lazy = number("-2.50", true), eager = number("-2.50", false);
+    JSON::Number a(lazy->cast<JSON::Number>()), b(eager->cast<JSON::Number>());
+    JSON::Number c(std::move(a)), d(1.0);
+    d = b;
+    return c.dump() == "-2.50" && c.is_lazy() && d.dump() == "-2.50" &&
+           b.dump() == "-2.50" && c.value_double() == -2.5;
+  });
+  // Lazy numbers view their literal, eager ones own it, in the same member.
+  res.emplace_back("one literal member", [] {
+    return sizeof(JSON::Number) <= sizeof(std::string) + 5 * sizeof(void *);
+  });
+  res.emplace_back("value_int clamps", [] {
+    constexpr auto inf = std::numeric_limits<double>::infinity();
+    return JSON::Number(1e300).value_int() ==
+               std::numeric_limits<int64_t>::max() &&
+           JSON::Number(-inf).value_int() ==
+               std::numeric_limits<int64_t>::min() &&
+           JSON::Number(std::nan("")).value_int() == 0 &&
+           JSON::Number(-2.75).value_int() == -2;
+  });
+  return res;
+}
+
+Checks binaryChecks() {
+  const std::string text =
+      R"({"ints":[0,1,-1,127,128,-32,-33,255,65536,-2147483649,)"
+      R"(9223372036854775807,-9223372036854775808],)"
+      R"("doubles":[0.1,1e-7,123456.789012345,1.5,-0.0,1.0,1e300],)"
+      R"("s":"h\u00e9llo","long":")" +
+      std::string(300, 'x') + R"(","n":null,"t":true,"f":false,"o":{}})";
+  // Decodes raw bytes given as a list of byte values.
+  auto bytes = [](std::initializer_list<int> list) {
+    std::string res;
+    for (auto b : list)
+      res += static_cast<char>(b);
+    return res;
+  };
+  auto number = [](const JSON &json) -> const JSON::Number & {
+    return json->cast<JSON::Number>();
+  };
+  return {
+      {"msgpack round trip keeps the tree",
+       [=] {
+         auto json = JSON::parse(text);
+         return sameTree(JSON::from_msgpack(JSON::to_msgpack(json)), json);
+       }},
+      {"msgpack keys of every string width",
+       [=] {
+         auto json = JSON::parse(R"({"k":1,")" + std::string(40, 'a') +
+                                 R"(":2,")" + std::string(300, 'b') +
+                                 R"(":3})");
+         // {1: 2} has an integer key.
+         return sameTree(JSON::from_msgpack(JSON::to_msgpack(json)), json) &&
+                throws([=] { JSON::from_msgpack(bytes({0x81, 0x01, 0x02})); });
+       }},
+      {"cbor round trip keeps the tree",
+       [=] {
+         auto json = JSON::parse(text);
+         return sameTree(JSON::from_cbor(JSON::to_cbor(json)), json);
+       }},
+      {"decoded doubles dump exactly",
+       [] {
+         auto json = JSON::parse("[0.1,1e-7,123456.789012345,1.5,1.0,-0.0]");
+         auto decoded = JSON::from_msgpack(JSON::to_msgpack(json));
+         return decoded->dump() ==
+                    "[0.1,1e-07,123456.789012345,1.5,1.0,-0.0]" &&
+                sameTree(JSON::parse(decoded->dump()), json);
+       }},
+      {"non-finite doubles dump as null",
+       [] {
+         JSON json(std::numeric_limits<double>::infinity());
+         return json->dump() == "null";
+       }},
+      {"msgpack uint64 beyond int64_t becomes a double",
+       [=] {
+         auto json = JSON::from_msgpack(
+             bytes({0xcf, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}));
+         return number(json).is_double() &&
+                number(json).value_double() == 0x1p64;
+       }},
+      {"cbor negative beyond int64_t becomes a double",
+       [=] {
+         auto json = JSON::from_cbor(
+             bytes({0x3b, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}));
+         return number(json).is_double() &&
+                number(json).value_double() == -0x1p64;
+       }},
+      {"msgpack float32",
+       [=] {
+         auto json = JSON::from_msgpack(bytes({0xca, 0x3f, 0xc0, 0, 0}));
+         return number(json).is_double() && number(json).value_double() == 1.5;
+       }},
+      {"cbor float16 and float32",
+       [=] {
+         auto json = JSON::from_cbor(
+             bytes({0x83, 0xf9, 0x3c, 0x00, 0xf9, 0xc4, 0x00, 0xfa, 0x3f, 0xc0,
+                    0x00, 0x00}));
+         return json->dump() == "[1.0,-4.0,1.5]";
+       }},
+      {"cbor indefinite-length containers and text",
+       [=] {
+         // {_ "a": [_ 1, "x"], (_ "b" "c"): null}
+         auto json = JSON::from_cbor(
+             bytes({0xbf, 0x61, 'a', 0x9f, 0x01, 0x61, 'x', 0xff, 0x7f, 0x61,
+                    'b', 0x61, 'c', 0xff, 0xf6, 0xff}));
+         return sameTree(json, JSON::parse(R"({"a":[1,"x"],"bc":null})"));
+       }},
+      {"truncated input throws",
+       [=] {
+         auto json = JSON::parse(text);
+         auto msgpack = JSON::to_msgpack(json), cbor = JSON::to_cbor(json);
+         for (size_t n = 0; n < msgpack.size(); n++) {
+           if (!throws<JSON::JSONParseException>([&] {
+                 JSON::from_msgpack(std::string_view(msgpack).substr(0, n));
+               }))
+             return false;
+         }
+         for (size_t n = 0; n < cbor.size(); n++) {
+           if (!throws<JSON::JSONParseException>([&] {
+                 JSON::from_cbor(std::string_view(cbor).substr(0, n));
+               }))
+             return false;
+         }
+         return true;
+       }},
+  };
+}
+
+Checks snapshotChecks() {
+  const std::string text =
+      R"({"a":[1,-2,0.1,123456.789012345,"s",null,true,false],)"
+      R"("b":{"c":{},"d":[]},"big":-9223372036854775808,"e":1e300})";
+  // Overwrites the u64 at `off` of a snapshot.
+  auto patch = [](std::string snap, size_t off, uint64_t v) {
+    for (int i = 0; i < 8; i++)
+      snap[off + i] = static_cast<char>(v >> (i * 8));
+    return snap;
+  };
+  auto root = [](const std::string &snap) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+      v = (v << 8) | static_cast<uint8_t>(snap[8 + i]);
+    return v;
+  };
+  return {
+      {"round trip keeps the tree",
+       [=] {
+         auto json = JSON::parse(text);
+         auto snap = JSON::to_snapshot(json);
+         auto view = JSON::SnapshotView::open(snap);
+         return sameTree(view.toJSON(), json) &&
+                sameTree(JSON::parse(view.dump()), json);
+       }},
+      {"lookups",
+       [=] {
+         auto snap = JSON::to_snapshot(JSON::parse(text));
+         auto view = JSON::SnapshotView::open(snap);
+         return view["a"][1].value_int() == -2 &&
+                view["a"][4].value_string() == "s" &&
+                view["big"].value_int() ==
+                    std::numeric_limits<int64_t>::min() &&
+                !view.find("missing") && view["b"]["c"].size() == 0;
+       }},
+      {"doubles dump exactly",
+       [] {
+         auto snap = JSON::to_snapshot(JSON::parse("[0.1,123456.789012345]"));
+         return JSON::SnapshotView::open(snap).dump() ==
+                "[0.1,123456.789012345]";
+       }},
+      {"truncated snapshot throws",
+       [=] {
+         auto snap = JSON::to_snapshot(JSON::parse(text));
+         for (size_t n = 0; n < snap.size(); n++) {
+           if (!throws([&] {
+                 JSON::SnapshotView::open(std::string_view(snap).substr(0, n))
+                     .dump();
+               }))
+             return false;
+         }
+         return true;
+       }},
+      {"child pointing at itself throws",
+       [=] {
+         auto snap = JSON::to_snapshot(JSON::parse("[1]"));
+         // The array record: tag, count, then its only child offset.
+         auto bad = patch(snap, root(snap) + 9, root(snap));
+         auto view = JSON::SnapshotView::open(bad);
+         return throws([&] { view.dump(); }) &&
+                throws([&] { view.toJSON(); });
+       }},
+      {"child pointing at an ancestor throws",
+       [=] {
+         auto snap = JSON::to_snapshot(JSON::parse("[[1]]"));
+         auto inner = root(snap) - 17;
+         auto bad = patch(snap, inner + 9, root(snap));
+         return throws([&] { JSON::SnapshotView::open(bad).dump(); });
+       }},
+      {"nesting deeper than the parser allows throws",
+       [] {
+         JSON json;
+         for (int i = 0; i < JSON::MAX_RECURSE_DEPTH + 2; i++) {
+           JSON::Array::ArrayVT val;
+           val.push_back(std::move(json));
+           json = JSON(std::make_unique<JSON::Array>(std::move(val)));
+         }
+         auto snap = JSON::to_snapshot(json);
+         return throws([&] { JSON::SnapshotView::open(snap).dump(); });
+       }},
+      {"number text must be a number literal",
+       [] {
+         auto snap = JSON::staticSnapshot("[1.5]");
+         auto at = snap.find("1.5");
+         auto bad = snap;
+         bad.replace(at, 3, R"("x")");
+         auto view = JSON::SnapshotView::open(bad)[0];
+         return JSON::SnapshotView::open(snap).dump() == "[1.5]" &&
+                throws([=] { view.dump(); }) &&
+                throws([=] { view.toJSON(); }) &&
+                throws([=] { view.is_double(); });
+       }},
+      {"corrupted bytes throw instead of crashing",
+       [=] {
+         auto snap = JSON::to_snapshot(JSON::parse(text));
+         for (size_t i = 0; i < snap.size(); i++) {
+           for (int bit = 0; bit < 8; bit++) {
+             auto bad = snap;
+             bad[i] = static_cast<char>(bad[i] ^ (1 << bit));
+             try {
+               auto view = JSON::SnapshotView::open(bad);
+               view.dump();
+               view.toJSON();
+             } catch (const std::exception &) {
+             }
+           }
+         }
+         return true;
+       }},
+  };
+}
+
+Checks limitChecks() {
+  auto parse = [](std::string_view text, auto set) {
+    JSON::ParseOptions opts;
+    set(opts);
+    return JSON::parse(text, opts);
+  };
+  auto error = [=](std::string_view text, auto set) -> std::string {
+    try {
+      parse(text, set);
+    } catch (const JSON::JSONException &e) {
+      return e.what();
+    }
+    return "";
+  };
+  // Parses with max_bytes at memoryUsage() and one byte below it.
+  auto charges_exactly = [=](std::string_view text) {
+    auto size = JSON::parse(text)->memoryUsage();
+    auto fits = [=](size_t max) {
+      return !throws([=] {
+        parse(text, [=](auto &opts) { opts.max_bytes = max; });
+      });
+    };
+    return fits(size) && !fits(size - 1);
+  };
+  std::string big_keys = "{";
+  for (int i = 0; i < 1000; i++)
+    big_keys += "\"" + std::to_string(i) + std::string(1000, 'k') + "\":null,";
+  // Malformed at the end, so only an early limit reports max bytes.
+  big_keys += "]";
+  return {
+      {"max_bytes rejects keys before their object closes",
+       [=] {
+         return error(big_keys, [](auto &opts) {
+                  opts.max_bytes = 1 << 16;
+                }).find("max bytes") != std::string::npos;
+       }},
+      {"charged bytes equal memoryUsage()",
+       [=] {
+         return charges_exactly("null") && charges_exactly("[1,2.5,\"x\"]") &&
+                charges_exactly(R"({"a":[1,{"b":"long enough for heap"}]})") &&
+                charges_exactly(R"({"long key outside the SSO buffer":{}})");
+       }},
+      {"duplicated keys are not charged after their object closes",
+       [=] {
+         auto text = R"([{"a":1,"a":2},")" + std::string(200, 's') + "\"]";
+         return JSON::parse(R"({"a":1,"a":2})")->dump() == R"({"a":1})" &&
+                charges_exactly(text);
+       }},
+      {"max_nodes",
+       [=] {
+         auto set = [](auto &opts) { opts.max_nodes = 5; };
+         return !throws([=] { parse("[1,[2],3]", set); }) &&
+                throws([=] { parse("[1,[2],3,4]", set); });
+       }},
+      {"max_string_length",
+       [=] {
+         auto set = [](auto &opts) { opts.max_string_length = 3; };
+         return !throws([=] { parse(R"({"abc":"def"})", set); }) &&
+                throws([=] { parse(R"(["abcd"])", set); }) &&
+                throws([=] { parse(R"({"abcd":0})", set); });
+       }},
+      {"max_object_members",
+       [=] {
+         auto set = [](auto &opts) { opts.max_object_members = 2; };
+         return !throws([=] { parse(R"({"a":{"b":0,"c":0},"d":0})", set); }) &&
+                throws([=] { parse(R"({"a":0,"b":0,"c":0})", set); });
+       }},
+  };
+}
+
+Checks schemaChecks() {
+  auto schema = std::make_shared<JSON::Schema>(JSON::Schema::compile(R"({
+    "type": "object",
+    "required": ["id", "name"],
+    "properties": {
+      "id": {"type": "integer", "minimum": 1, "maximum": 5000},
+      "name": {"type": "string", "maxLength": 4},
+      "kind": {"enum": ["a", 2, null]},
+      "score": {"type": "number"},
+      "tags": {"type": "array", "items": {"type": "string"}},
+      "debug": {"x-skip": true}
+    },
+    "additionalProperties": {"type": "boolean"}
+  })"));
+  auto parse = [=](std::string_view text, bool lazy = false) {
+    JSON::ParseOptions opts;
+    opts.schema = schema.get();
+    opts.lazy_numbers = lazy;
+    return JSON::parse(text, opts);
+  };
+  // Offset of the violation, or npos if the text is valid.
+  auto violation = [=](std::string_view text) {
+    try {
+      parse(text);
+    } catch (const JSON::JSONSchemaException &e) {
+      return e.offset();
+    }
+    return std::string::npos;
+  };
+  return {
+      {"valid documents pass",
+       [=] {
+         return violation(R"({"id":1,"name":"ab"})") == std::string::npos &&
+                violation(R"({"name":"abcd","id":5000,"kind":2,"x":true,)"
+                          R"("tags":[],"score":0.5})") == std::string::npos;
+       }},
+      {"offsets point at the violating value",
+       [=] {
+         return violation(R"({"id":0,"name":"ab"})") == 6 &&
+                violation(R"({"id":1.5,"name":"ab"})") == 6 &&
+                violation(R"({"id":1,"name":"abcde"})") == 15 &&
+                violation(R"({"id":1,"name":"a","kind":"b"})") == 26 &&
+                violation(R"({"id":1,"name":"a","tags":["x",1]})") == 31 &&
+                violation(R"({"id":"1","name":"a"})") == 6;
+       }},
+      {"required members",
+       [=] {
+         return violation(R"({"id":1})") != std::string::npos &&
+                violation(R"({"name":"a"})") != std::string::npos &&
+                throws<JSON::JSONSchemaException>([=] { parse("[]"); });
+       }},
+      {"additionalProperties",
+       [=] {
+         auto closed = JSON::Schema::compile(
+             R"({"properties":{"a":{}},"additionalProperties":false})");
+         JSON::ParseOptions opts;
+         opts.schema = &closed;
+         return violation(R"({"id":1,"name":"a","x":false})") ==
+                    std::string::npos &&
+                violation(R"({"id":1,"name":"a","x":1})") == 23 &&
+                !throws([&] { JSON::parse(R"({"a":[1]})", opts); }) &&
+                throws<JSON::JSONSchemaException>(
+                    [&] { JSON::parse(R"({"a":1,"b":2})", opts); });
+       }},
+      {"x-skip leaves values out but checks their syntax",
+       [=] {
+         auto json = parse(R"({"id":1,"debug":{"x":[1,{}]},"name":"a"})");
+         return json->cast<JSON::Object>().value().size() == 2 &&
+                !json->cast<JSON::Object>().value().contains("debug") &&
+                throws([=] { parse(R"({"id":1,"name":"a","debug":[1,})"); });
+       }},
+      {"x-skip on the root schema is rejected",
+       [] {
+         return throws([] { JSON::Schema::compile(R"({"x-skip":true})"); });
+       }},
+      {"exponent literals are checked by value",
+       [=] {
+         return violation(R"({"id":1e3,"name":"a"})") == std::string::npos &&
+                parse(R"({"id":1e3,"name":"a"})")
+                        ->cast<JSON::Object>()["id"]
+                        ->dump() == "1e3" &&
+                violation(R"({"id":1e4,"name":"a"})") == 6 &&
+                violation(R"({"id":1.5e1,"name":"a"})") == std::string::npos;
+       }},
+      {"lazy numbers stay unconverted without numeric keywords",
+       [=] {
+         auto json = parse(R"({"id":7,"name":"a","score":2.5})", true);
+         auto &root = json->cast<JSON::Object>();
+         return root["score"]->cast<JSON::Number>().is_lazy() &&
+                !root["id"]->cast<JSON::Number>().is_lazy();
+       }},
+  };
+}
+
 int main(int argc, char **argv) {
   std::vector<std::string> args;
   for (int i = 1; i < argc; i++) {
@@ -118,6 +788,15 @@ int main(int argc, char **argv) {
 
   std::vector<Result> result;
 
+  result.push_back(check("dump cache", dumpCacheChecks()));
+  result.push_back(check("numbers", numberChecks()));
+  result.push_back(check("binary encodings", binaryChecks()));
+  result.push_back(check("snapshots", snapshotChecks()));
+  result.push_back(check("parse limits", limitChecks()));
+  result.push_back(check("schema", schemaChecks()));
+  auto failed_checks = std::ranges::count_if(
+      result, [](const Result &r) { return r.fail != 0; });
+
   result.push_back(test("nlohmann", [](auto, const std::string &s) {
     nlohmann::json::parse(s).dump();
   }));
@@ -132,4 +811,5 @@ int main(int argc, char **argv) {
   for (const auto &r : result) {
     r.print();
   }
+  return failed_checks == 0 ? 0 : 1;
 }
\ No newline at end of file